@@ -0,0 +1,92 @@
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "bench.hpp"
+#include "object_pool.hpp"
+
+// Per-request object graphs: every thread serves requests that build a tree
+// of `nodes` nodes, each hung under a random earlier one and kept in an
+// index, then drop all of it. Build and teardown are timed apart and
+// reported per node. The arena makes its blocks immortal only in release
+// builds, so build with NDEBUG for representative numbers.
+
+constexpr int nodes = 1000;
+
+struct Node {
+  long value;
+  lockfree::shared_ptr<Node> first_child;
+  lockfree::shared_ptr<Node> next_sibling;
+};
+
+template <typename Make, typename Teardown>
+void run(const std::string &name, int threads, long ops, Make make,
+         Teardown teardown) {
+  long requests = std::max(1L, ops / threads / nodes);
+  std::atomic<long> build_ns = 0, teardown_ns = 0;
+  bench::run(threads, [&](int t) {
+    std::minstd_rand rng(t + 1);
+    std::vector<lockfree::shared_ptr<Node>> index;
+    index.reserve(nodes);
+    long build = 0, drop = 0, sum = 0;
+    for (long r = 0; r < requests; ++r) {
+      long start = bench::now_ns();
+      index.push_back(make(t, Node{0, nullptr, nullptr}));
+      for (int i = 1; i < nodes; ++i) {
+        auto &parent = index[rng() % index.size()];
+        auto node = make(t, Node{i, nullptr, parent->first_child});
+        parent->first_child = node;
+        index.push_back(std::move(node));
+      }
+      sum += index.back()->value;
+      long built = bench::now_ns();
+      index.clear();
+      teardown(t);
+      long done = bench::now_ns();
+      build += built - start;
+      drop += done - built;
+    }
+    build_ns += build;
+    teardown_ns += drop;
+    volatile long sink = sum;
+    (void)sink;
+  });
+  long total = requests * nodes * threads;
+  bench::report((name + " build").c_str(), threads, total,
+                double(build_ns) / threads / 1e9);
+  bench::report((name + " teardown").c_str(), threads, total,
+                double(teardown_ns) / threads / 1e9);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+#ifndef NDEBUG
+  std::printf("# debug build: arena pointers are counted\n");
+#endif
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    auto none = [](int) {};
+    run("make_shared", threads, ops,
+        [](int, Node n) { return lockfree::make_shared<Node>(std::move(n)); },
+        none);
+    run("make_shared packed", threads, ops,
+        [](int, Node n) {
+          return lockfree::make_shared<Node>(lockfree::packed_layout,
+                                             std::move(n));
+        },
+        none);
+    lockfree::object_pool<Node> pool;
+    run("make_pooled", threads, ops,
+        [&](int, Node n) { return lockfree::make_pooled(pool, std::move(n)); },
+        none);
+    std::vector<lockfree::arena> arenas(threads);
+    run("make_shared_in", threads, ops,
+        [&](int t, Node n) {
+          return lockfree::make_shared_in<Node>(arenas[t], std::move(n));
+        },
+        [&](int t) { arenas[t].reset(); });
+  }
+}
@@ -0,0 +1,102 @@
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+#include "bench.hpp"
+
+// A writer publishes a new job spec every 200us; waiters pick each one up.
+// Reports how long after publication a waiter saw the job and how much CPU
+// the whole process burned per job, for four ways of waiting:
+//   wait        atomic_shared_ptr::wait, woken by notify_all
+//   condvar     a mutex and condition variable next to the pointer
+//   poll_sleep  load, then sleep 50us if nothing changed
+//   poll_yield  load, then yield if nothing changed
+
+struct Job {
+  int id;
+  long published_ns;
+};
+
+enum class mode { wait, condvar, poll_sleep, poll_yield };
+
+constexpr int waiters = 3;
+
+double cpu_seconds() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void run(const char *name, mode m, int jobs) {
+  lockfree::atomic_shared_ptr<Job> current(
+      lockfree::make_shared<Job>(Job{0, 0}));
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::vector<long>> samples(waiters);
+
+  double cpu = cpu_seconds();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < waiters; ++t) {
+    threads.emplace_back([&, t] {
+      auto seen = current.load();
+      while (seen->id != jobs) {
+        switch (m) {
+        case mode::wait:
+          current.wait(seen);
+          break;
+        case mode::condvar: {
+          std::unique_lock lk(mutex);
+          cv.wait(lk, [&] { return current.load().get() != seen.get(); });
+          break;
+        }
+        case mode::poll_sleep:
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+          break;
+        case mode::poll_yield:
+          std::this_thread::yield();
+          break;
+        }
+        auto next = current.load();
+        if (next.get() != seen.get()) {
+          samples[t].push_back(bench::now_ns() - next->published_ns);
+          seen = std::move(next);
+        }
+      }
+    });
+  }
+  for (int i = 1; i <= jobs; ++i) {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    current.store(lockfree::make_shared<Job>(Job{i, bench::now_ns()}));
+    if (m == mode::wait) {
+      current.notify_all();
+    } else if (m == mode::condvar) {
+      // Taking the lock orders the store before a waiter's check.
+      { std::lock_guard lk(mutex); }
+      cv.notify_all();
+    }
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  cpu = cpu_seconds() - cpu;
+
+  std::vector<long> all;
+  for (auto &s : samples) {
+    all.insert(all.end(), s.begin(), s.end());
+  }
+  bench::report_latency(name, all);
+  std::printf("%-28s %8s cpu/job=%.1fus\n", name, "", cpu * 1e6 / jobs);
+  std::fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  int jobs = int(bench::total_ops(argc, argv, 2000));
+  run("wait", mode::wait, jobs);
+  run("condvar", mode::condvar, jobs);
+  run("poll_sleep", mode::poll_sleep, jobs);
+  run("poll_yield", mode::poll_yield, jobs);
+}
@@ -0,0 +1,62 @@
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+#include "bench.hpp"
+
+// An observer registry: a few slots of weak references that every thread
+// reads and upgrades, and one in `replace_every` operations points at another
+// observer. "atomic_weak_ptr" is ours, "std_atomic_weak_ptr" is
+// std::atomic<std::weak_ptr> (a lock bit in libstdc++).
+
+struct Observer {
+  long events = 1;
+};
+
+constexpr int slots = 16;
+constexpr int observers = 64;
+constexpr long replace_every = 16;
+
+template <typename SharedPtr, typename AtomicWeak>
+void run(const char *name, int threads, long ops) {
+  std::vector<SharedPtr> owners;
+  for (int i = 0; i < observers; ++i) {
+    owners.emplace_back(new Observer);
+  }
+  std::vector<AtomicWeak> registry(slots);
+  for (int i = 0; i < slots; ++i) {
+    registry[i].store(owners[i]);
+  }
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int t) {
+    unsigned x = 2463534242u + t;
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      auto &slot = registry[x % slots];
+      if (i % replace_every == 0) {
+        slot.store(owners[x / slots % observers]);
+      } else if (auto p = slot.load().lock()) {
+        sum += p->events;
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 21);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run<lockfree::shared_ptr<Observer>,
+        lockfree::atomic_weak_ptr<Observer>>("atomic_weak_ptr", threads, ops);
+    run<std::shared_ptr<Observer>, std::atomic<std::weak_ptr<Observer>>>(
+        "std_atomic_weak_ptr", threads, ops);
+  }
+}
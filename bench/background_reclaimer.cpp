@@ -0,0 +1,72 @@
+#include <string>
+#include <vector>
+
+#include "background_reclaimer.hpp"
+#include "bench.hpp"
+
+// Request threads each build an object graph, use it and drop it. Records how
+// long the request thread spends dropping its last reference, with destruction
+// inline versus handed to the background reclaimer.
+
+struct node {
+  long payload[4] = {};
+  std::vector<lockfree::shared_ptr<node>> children;
+};
+
+constexpr int fanout = 32;
+
+template <bool Background> lockfree::shared_ptr<node> make_node() {
+  if constexpr (Background) {
+    return lockfree::make_shared<node>(lockfree::background_destroy);
+  } else {
+    return lockfree::make_shared<node>();
+  }
+}
+
+// A root with fanout^2 grandchildren. Only the root needs the background
+// deleter: everything below it dies on the reclaimer thread anyway.
+template <bool Background> lockfree::shared_ptr<node> build() {
+  auto root = make_node<Background>();
+  for (int i = 0; i < fanout; ++i) {
+    auto child = lockfree::make_shared<node>();
+    for (int j = 0; j < fanout; ++j) {
+      child->children.push_back(lockfree::make_shared<node>());
+    }
+    root->children.push_back(std::move(child));
+  }
+  return root;
+}
+
+template <bool Background>
+void run(const char *name, int threads, long requests) {
+  long per_thread = requests / threads;
+  std::vector<std::vector<long>> latencies(threads);
+  double secs = bench::run(threads, [&](int t) {
+    auto &samples = latencies[t];
+    samples.reserve(per_thread);
+    for (long i = 0; i < per_thread; ++i) {
+      auto graph = build<Background>();
+      graph->payload[0] = i;
+      long start = bench::now_ns();
+      graph.reset();
+      samples.push_back(bench::now_ns() - start);
+    }
+  });
+  lockfree::background_reclaimer::global().drain();
+
+  std::vector<long> all;
+  for (auto &l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  bench::report(name, threads, per_thread * threads, secs);
+  bench::report_latency(name, all);
+}
+
+int main(int argc, char **argv) {
+  long requests = bench::total_ops(argc, argv, 1 << 12);
+  bench::header();
+  for (int threads : {1, 4}) {
+    run<false>("inline destruction", threads, requests);
+    run<true>("background destruction", threads, requests);
+  }
+}
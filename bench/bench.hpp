@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "perf_counters.hpp"
+
+// Tiny benchmark harness shared by the targets in this directory.
+
+namespace bench {
+
+// Thread counts every scalability benchmark sweeps over.
+inline const std::vector<int> thread_counts{1, 2, 4, 8, 16, 32, 64};
+
+// Total operations of a run, from argv[1] if given.
+inline long total_ops(int argc, char **argv, long fallback) {
+  return argc > 1 ? std::atol(argv[1]) : fallback;
+}
+
+// Starts `threads` threads together, runs `body(thread_index)` on each and
+// returns the wall-clock seconds until the last one finished. Perf counters,
+// if enabled, cover the same span and show up in the next report().
+template <typename F> double run(int threads, F body) {
+  auto &counters = perf_counters::get();
+  counters.open();
+  std::atomic<int> ready = 0;
+  std::atomic<bool> go = false;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      ++ready;
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      body(t);
+    });
+  }
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  counters.start();
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto &w : workers) {
+    w.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  counters.stop();
+  return elapsed.count();
+}
+
+inline void header() {
+  std::printf("%-28s %8s %14s %10s", "name", "threads", "ops/s", "ns/op");
+  perf_counters::get().header();
+  std::printf("\n");
+}
+
+inline void report(const char *name, int threads, long ops, double seconds) {
+  std::printf("%-28s %8d %14.0f %10.1f", name, threads, ops / seconds,
+              seconds * 1e9 / ops);
+  perf_counters::get().report(ops);
+  std::printf("\n");
+  std::fflush(stdout);
+}
+
+// Nanoseconds on a monotonic clock, for latency samples.
+inline long now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The p-th percentile (0 <= p <= 100) of `samples`. Sorts them in place.
+inline long percentile(std::vector<long> &samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto i = static_cast<std::size_t>(p / 100 * (samples.size() - 1));
+  return samples[i];
+}
+
+inline void report_latency(const char *name, std::vector<long> &samples) {
+  long p50 = percentile(samples, 50);
+  long p99 = percentile(samples, 99);
+  long p999 = percentile(samples, 99.9);
+  std::printf("%-28s %8s p50=%ldns p99=%ldns p99.9=%ldns\n", name, "", p50,
+              p99, p999);
+  std::fflush(stdout);
+}
+
+} // namespace bench
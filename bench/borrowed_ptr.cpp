@@ -0,0 +1,77 @@
+#include <cstdio>
+
+#include "bench.hpp"
+#include "borrowed_ptr.hpp"
+
+// A request object handed down a chain of `depth` calls by every thread; the
+// innermost call keeps a reference one time in 64. Reported per chain. The
+// empty asm after each call keeps the compiler from turning the chain into a
+// loop.
+
+struct Request {
+  long id = 7;
+};
+
+constexpr int depth = 16;
+
+lockfree::shared_ptr<Request> kept;
+
+template <typename P>
+[[gnu::noinline]] long by_value(P p, int n, long i) {
+  if (n == 0) {
+    if (i % 64 == 0) {
+      lockfree::shared_ptr<Request> keep = p;
+    }
+    return p->id;
+  }
+  long r = by_value<P>(p, n - 1, i);
+  asm volatile("" ::: "memory");
+  return r + 1;
+}
+
+[[gnu::noinline]] long by_borrow(lockfree::borrowed_ptr<Request> p, int n,
+                                 long i) {
+  if (n == 0) {
+    if (i % 64 == 0) {
+      lockfree::shared_ptr<Request> keep = p.share();
+    }
+    return p->id;
+  }
+  long r = by_borrow(p, n - 1, i);
+  asm volatile("" ::: "memory");
+  return r + 1;
+}
+
+template <typename F>
+void run(const char *name, int threads, long ops, F chain) {
+  auto request = lockfree::make_shared<Request>();
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      sum += chain(request, i);
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 20);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run("shared_ptr by value", threads, ops,
+        [](const lockfree::shared_ptr<Request> &r, long i) {
+          return by_value<lockfree::shared_ptr<Request>>(r, depth, i);
+        });
+    run("const shared_ptr &", threads, ops,
+        [](const lockfree::shared_ptr<Request> &r, long i) {
+          return by_value<const lockfree::shared_ptr<Request> &>(r, depth, i);
+        });
+    run("borrowed_ptr", threads, ops,
+        [](const lockfree::shared_ptr<Request> &r, long i) {
+          return by_borrow(r, depth, i);
+        });
+  }
+}
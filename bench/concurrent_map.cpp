@@ -0,0 +1,73 @@
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "bench.hpp"
+#include "concurrent_map.hpp"
+
+// Random reads and writes over a prepopulated key range. Compares
+// lockfree::concurrent_map with a std::unordered_map guarded by a
+// std::shared_mutex at 95/5 and 50/50 read/write mixes.
+
+using value_ptr = lockfree::shared_ptr<long>;
+
+struct shared_mutex_map {
+  mutable std::shared_mutex m;
+  std::unordered_map<long, value_ptr> map;
+
+  value_ptr find(long key) const {
+    std::shared_lock lk(m);
+    auto it = map.find(key);
+    return it == map.end() ? nullptr : it->second;
+  }
+
+  void insert_or_assign(long key, value_ptr v) {
+    std::unique_lock lk(m);
+    map.insert_or_assign(key, std::move(v));
+  }
+};
+
+constexpr long keys = 1 << 16;
+
+template <typename Map>
+void run(const char *name, int read_percent, int threads, long ops) {
+  Map m;
+  for (long k = 0; k < keys; ++k) {
+    m.insert_or_assign(k, lockfree::make_shared<long>(k));
+  }
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int t) {
+    std::mt19937_64 rng(t);
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      long key = rng() % keys;
+      if (long(rng() % 100) < read_percent) {
+        if (auto v = m.find(key)) {
+          sum += *v;
+        }
+      } else {
+        m.insert_or_assign(key, lockfree::make_shared<long>(i));
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  std::string label = std::string(name) + " " +
+                      std::to_string(read_percent) + "/" +
+                      std::to_string(100 - read_percent);
+  bench::report(label.c_str(), threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 19);
+  bench::header();
+  for (int read_percent : {95, 50}) {
+    for (int threads : bench::thread_counts) {
+      run<lockfree::concurrent_map<long, long>>("concurrent_map",
+                                                read_percent, threads, ops);
+      run<shared_mutex_map>("shared_mutex map", read_percent, threads, ops);
+    }
+  }
+}
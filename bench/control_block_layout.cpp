@@ -0,0 +1,54 @@
+#include <atomic>
+#include <cstdio>
+
+#include "bench.hpp"
+#include "shared_ptr.hpp"
+
+// False sharing between reference counts and the object. Even threads read
+// the object's fields, odd threads copy and drop references to it; reported
+// is the readers' time per scan. "separate" is plain make_shared (object and
+// control block in two allocations).
+
+struct Point {
+  long x = 1, y = 2, z = 3;
+};
+
+template <typename Make>
+void run(const char *name, int threads, long ops, Make make) {
+  lockfree::shared_ptr<Point> p = make();
+  int readers = (threads + 1) / 2;
+  long per_reader = ops / readers;
+  std::atomic<int> finished = 0;
+  double secs = bench::run(threads, [&](int t) {
+    if (t % 2 == 0) {
+      const volatile Point *q = p.get();
+      long sum = 0;
+      for (long i = 0; i < per_reader; ++i) {
+        sum += q->x + q->y + q->z;
+      }
+      volatile long sink = sum;
+      (void)sink;
+      finished.fetch_add(1, std::memory_order_release);
+    } else {
+      while (finished.load(std::memory_order_acquire) != readers) {
+        lockfree::shared_ptr<Point> copy = p;
+      }
+    }
+  });
+  bench::report(name, threads, per_reader * readers, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 24);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run("separate", threads, ops,
+        [] { return lockfree::make_shared<Point>(); });
+    run("packed", threads, ops, [] {
+      return lockfree::make_shared<Point>(lockfree::packed_layout);
+    });
+    run("isolated", threads, ops, [] {
+      return lockfree::make_shared<Point>(lockfree::isolated_layout);
+    });
+  }
+}
@@ -0,0 +1,79 @@
+#include <mutex>
+#include <vector>
+
+#include "bench.hpp"
+#include "cow_cell.hpp"
+
+// Reader throughput while one writer publishes a new version every
+// millisecond. Compares cow_cell::read(), cow_cell::read_guarded() and a
+// shared_ptr guarded by a std::mutex; a reader-preferring std::shared_mutex
+// starves the writer outright under this load. argv[1] is the run time in ms.
+
+struct Config {
+  std::vector<long> values = std::vector<long>(16);
+  long version = 0;
+};
+
+struct mutex_cell {
+  mutable std::mutex m;
+  lockfree::shared_ptr<const Config> value =
+      lockfree::make_shared<const Config>();
+
+  lockfree::shared_ptr<const Config> read() const {
+    std::lock_guard lk(m);
+    return value;
+  }
+
+  template <typename F> void update(F fn) {
+    auto next = lockfree::make_shared<Config>(*read());
+    fn(*next);
+    std::lock_guard lk(m);
+    value = std::move(next);
+  }
+};
+
+template <typename Cell, typename Read>
+void run(const char *name, int readers, long ms, Read read) {
+  Cell cell;
+  std::atomic<bool> stop = false;
+  std::atomic<long> reads = 0;
+  double secs = bench::run(readers + 1, [&](int t) {
+    if (t == 0) {
+      auto now = std::chrono::steady_clock::now();
+      auto end = now + std::chrono::milliseconds(ms);
+      auto next = now;
+      while (now < end) {
+        cell.update([](Config &c) { ++c.version; });
+        // Don't try to catch up on ticks missed while descheduled.
+        next = std::max(next + std::chrono::milliseconds(1), now);
+        std::this_thread::sleep_until(next);
+        now = std::chrono::steady_clock::now();
+      }
+      stop = true;
+      return;
+    }
+    long n = 0, sum = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+      sum += read(cell);
+      ++n;
+    }
+    reads += n;
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, readers, reads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ms = bench::total_ops(argc, argv, 200);
+  bench::header();
+  for (int readers : bench::thread_counts) {
+    using cell = lockfree::cow_cell<Config>;
+    run<cell>("cow_cell::read", readers, ms,
+              [](cell &c) { return c.read()->version; });
+    run<cell>("cow_cell::read_guarded", readers, ms,
+              [](cell &c) { return c.read_guarded()->version; });
+    run<mutex_cell>("mutex shared_ptr", readers, ms,
+                    [](mutex_cell &c) { return c.read()->version; });
+  }
+}
@@ -0,0 +1,43 @@
+#include <cstdio>
+
+#include "atomic_shared_ptr.hpp"
+#include "bench.hpp"
+
+// Read-side cost of atomic_shared_ptr: protect() only publishes a hazard
+// pointer, load() also takes a reference. Built twice, as
+// bench_hazard_pointer (membarrier where available) and
+// bench_hazard_pointer_fenced (-DLOCKFREE_NO_MEMBARRIER, a seq_cst fence per
+// protected load).
+
+template <bool Load>
+void run(const char *name, lockfree::atomic_shared_ptr<long> &a, int threads,
+         long ops) {
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      if constexpr (Load) {
+        sum += *a.load();
+      } else {
+        lockfree::hazard_pointer hp;
+        sum += *a.protect(hp);
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+  std::printf("asymmetric fences: %s\n",
+              lockfree::detail::asymmetric_fence::expedited() ? "membarrier"
+                                                              : "off");
+  lockfree::atomic_shared_ptr<long> a(lockfree::make_shared<long>(1));
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run<false>("protect", a, threads, ops);
+    run<true>("load", a, threads, ops);
+  }
+}
@@ -0,0 +1,39 @@
+#include <cstdio>
+
+#include "bench.hpp"
+#include "shared_ptr.hpp"
+
+// Every thread copies one shared sentinel and drops the copy, as code handing
+// out a default config or an empty string does. "mortal" counts every copy,
+// "immortal" only reads the sentinel's control block.
+
+struct Config {
+  int retries = 3;
+};
+
+void run(const char *name, const lockfree::shared_ptr<Config> &sentinel,
+         int threads, long ops) {
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      lockfree::shared_ptr<Config> copy = sentinel;
+      sum += copy->retries;
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 23);
+  static const auto config = lockfree::make_immortal<Config>();
+  auto mortal = lockfree::make_shared<Config>();
+  auto immortal = config.share();
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run("mortal", mortal, threads, ops);
+    run("immortal", immortal, threads, ops);
+  }
+}
@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <memory>
+#include <new>
+
+#include "shared_ptr.hpp"
+
+// Heap bytes and allocations behind one shared object, per construction
+// path, for lockfree::shared_ptr and std::shared_ptr. Every figure comes from
+// malloc_usable_size() on what operator new handed out, or for control
+// blocks from slab_allocator, the size class it rounded up to. So it
+// includes the allocator's rounding but not its per-chunk header or free
+// slots. "overhead" is usable bytes minus the payload itself. make_immortal
+// isn't listed: it lives in static storage and costs no heap at all. Not a
+// timing benchmark: the numbers are exact and the same on every run, but
+// -DLOCKFREE_CHECK_BORROWS adds a borrow count to every control block.
+
+namespace {
+
+struct counts {
+  long allocations = 0;
+  long requested = 0;
+  long usable = 0;
+};
+
+counts current;
+bool armed = false;
+
+void *counted(void *p, std::size_t n) {
+  if (!p) {
+    throw std::bad_alloc{};
+  }
+  if (armed) {
+    ++current.allocations;
+    current.requested += long(n);
+    current.usable += long(malloc_usable_size(p));
+  }
+  return p;
+}
+
+} // namespace
+
+void *operator new(std::size_t n) { return counted(std::malloc(n ? n : 1), n); }
+
+void *operator new(std::size_t n, std::align_val_t a) {
+  auto align = static_cast<std::size_t>(a);
+  return counted(std::aligned_alloc(align, (n + align - 1) / align * align), n);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+template <std::size_t N> struct Obj {
+  char bytes[N];
+};
+
+// Never referenced weakly, so its control block has no weak count.
+template <std::size_t N> struct LeanObj {
+  char bytes[N];
+};
+
+namespace lockfree {
+template <std::size_t N>
+struct disable_weak_ptr<LeanObj<N>> : std::true_type {};
+} // namespace lockfree
+
+constexpr long array_length = 16;
+
+// Measures what `make()` allocates for an object holding `payload` bytes.
+template <typename F> void row(const char *name, long payload, F make) {
+  // Leaves a free slot behind, so carving a slab isn't counted.
+  make();
+  current = {};
+  auto slab = lockfree::slab_allocator::thread_usage();
+  armed = true;
+  auto p = make();
+  armed = false;
+  auto after = lockfree::slab_allocator::thread_usage();
+  current.allocations += after.allocations - slab.allocations;
+  current.requested += after.requested - slab.requested;
+  current.usable += after.usable - slab.usable;
+  std::printf("%-36s %8ld %7ld %10ld %8ld %9ld\n", name, payload,
+              current.allocations, current.requested, current.usable,
+              current.usable - payload);
+}
+
+template <std::size_t N> void sizes() {
+  using T = Obj<N>;
+  using lockfree::packed_layout;
+  using lockfree::isolated_layout;
+  // Big enough that std::function can't keep it inline.
+  struct { char state[32]; } big{};
+  auto stateful = [big](T *p) { (void)big; delete p; };
+  auto stateless = [](T *p) { delete p; };
+  long array_bytes = long(N) * array_length;
+
+  std::printf("-- sizeof(T) = %zu\n", N);
+  row("lockfree shared_ptr(new T)", N,
+      [] { return lockfree::shared_ptr<T>(new T); });
+  row("lockfree shared_ptr(new T, d)", N,
+      [&] { return lockfree::shared_ptr<T>(new T, stateless); });
+  row("lockfree shared_ptr(new T, d[32B])", N,
+      [&] { return lockfree::shared_ptr<T>(new T, stateful); });
+  row("lockfree make_shared", N, [] { return lockfree::make_shared<T>(); });
+  row("lockfree make_shared(packed)", N,
+      [] { return lockfree::make_shared<T>(packed_layout); });
+  row("lockfree make_shared(isolated)", N,
+      [] { return lockfree::make_shared<T>(isolated_layout); });
+  row("lockfree allocate_shared", N,
+      [] { return lockfree::allocate_shared<T>(std::allocator<T>{}); });
+  row("lockfree packed, disable_weak_ptr", N, [] {
+    return lockfree::make_shared<LeanObj<N>>(packed_layout);
+  });
+  row("lockfree shared_ptr<T[]>(new T[16])", array_bytes,
+      [] { return lockfree::shared_ptr<T[]>(new T[array_length]); });
+  row("lockfree make_shared<T[]>(16)", array_bytes,
+      [] { return lockfree::make_shared<T[]>(array_length); });
+  row("std shared_ptr(new T)", N, [] { return std::shared_ptr<T>(new T); });
+  row("std shared_ptr(new T, d)", N,
+      [&] { return std::shared_ptr<T>(new T, stateless); });
+  row("std shared_ptr(new T, d[32B])", N,
+      [&] { return std::shared_ptr<T>(new T, stateful); });
+  row("std make_shared", N, [] { return std::make_shared<T>(); });
+  row("std allocate_shared", N,
+      [] { return std::allocate_shared<T>(std::allocator<T>{}); });
+  row("std shared_ptr<T[]>(new T[16])", array_bytes,
+      [] { return std::shared_ptr<T[]>(new T[array_length]); });
+  row("std make_shared<T[]>(16)", array_bytes,
+      [] { return std::make_shared<T[]>(array_length); });
+}
+
+int main() {
+#ifdef LOCKFREE_CHECK_BORROWS
+  std::printf("# control blocks include the borrow count\n");
+#endif
+#ifndef LOCKFREE_HAVE_SLAB
+  std::printf("# control blocks from operator new\n");
+#endif
+  std::printf("%-36s %8s %7s %10s %8s %9s\n", "variant", "payload", "allocs",
+              "requested", "usable", "overhead");
+  sizes<8>();
+  sizes<64>();
+  sizes<256>();
+  sizes<4096>();
+}
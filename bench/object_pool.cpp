@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "object_pool.hpp"
+
+// Every thread keeps a window of the last `window` objects it made, as a
+// request handler keeps its in-flight requests, and replaces the oldest on
+// each operation. Objects are zeroed on construction. "pooled" constructs
+// them again on reuse, "pooled reset" hands them out as they were left.
+
+constexpr int window = 16;
+
+template <int Size> struct Payload {
+  unsigned char bytes[Size] = {};
+};
+
+template <typename Make>
+void run(const std::string &name, int threads, long ops, Make make) {
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    std::vector<decltype(make())> live(window);
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      auto &p = live[i % window];
+      p = make();
+      sum += p->bytes[0];
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name.c_str(), threads, per_thread * threads, secs);
+}
+
+template <int Size> void run_size(long ops) {
+  using T = Payload<Size>;
+  auto label = [](const char *what) {
+    return std::string(what) + " " + std::to_string(Size);
+  };
+  lockfree::object_pool<T> pool;
+  lockfree::object_pool<T> reset_pool([](T &) {});
+  for (int threads : bench::thread_counts) {
+    run(label("make_shared"), threads, ops,
+        [] { return lockfree::make_shared<T>(); });
+    run(label("make_shared packed"), threads, ops,
+        [] { return lockfree::make_shared<T>(lockfree::packed_layout); });
+    run(label("pooled"), threads, ops,
+        [&] { return lockfree::make_pooled(pool); });
+    run(label("pooled reset"), threads, ops,
+        [&] { return lockfree::make_pooled(reset_pool); });
+  }
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+  bench::header();
+  run_size<16>(ops);
+  run_size<256>(ops);
+  run_size<4096>(ops);
+}
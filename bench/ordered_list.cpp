@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "ordered_list.hpp"
+
+// A small sorted registry (subscribers by priority): every "event" walks the
+// whole set, 1% of operations insert or erase. Compares lockfree::ordered_list
+// with a std::list behind a std::mutex and a sorted std::vector behind a
+// std::shared_mutex.
+
+using value_ptr = lockfree::shared_ptr<long>;
+
+struct mutex_list {
+  std::mutex m;
+  std::list<std::pair<long, value_ptr>> list;
+
+  long visit() {
+    std::lock_guard lk(m);
+    long sum = 0;
+    for (auto &[key, value] : list) {
+      sum += *value;
+    }
+    return sum;
+  }
+
+  void insert(long key, value_ptr v) {
+    std::lock_guard lk(m);
+    auto it = std::find_if(list.begin(), list.end(),
+                           [&](auto &e) { return e.first >= key; });
+    if (it == list.end() || it->first != key) {
+      list.emplace(it, key, std::move(v));
+    }
+  }
+
+  void erase(long key) {
+    std::lock_guard lk(m);
+    list.remove_if([&](auto &e) { return e.first == key; });
+  }
+};
+
+struct shared_mutex_vector {
+  std::shared_mutex m;
+  std::vector<std::pair<long, value_ptr>> vec;
+
+  long visit() {
+    std::shared_lock lk(m);
+    long sum = 0;
+    for (auto &[key, value] : vec) {
+      sum += *value;
+    }
+    return sum;
+  }
+
+  void insert(long key, value_ptr v) {
+    std::unique_lock lk(m);
+    auto it = std::lower_bound(vec.begin(), vec.end(), key,
+                               [](auto &e, long k) { return e.first < k; });
+    if (it == vec.end() || it->first != key) {
+      vec.emplace(it, key, std::move(v));
+    }
+  }
+
+  void erase(long key) {
+    std::unique_lock lk(m);
+    auto it = std::lower_bound(vec.begin(), vec.end(), key,
+                               [](auto &e, long k) { return e.first < k; });
+    if (it != vec.end() && it->first == key) {
+      vec.erase(it);
+    }
+  }
+};
+
+struct lockfree_list {
+  lockfree::ordered_list<long, long> list;
+
+  long visit() {
+    long sum = 0;
+    list.for_each([&](long, long value) { sum += value; });
+    return sum;
+  }
+
+  void insert(long key, value_ptr v) { list.insert(key, std::move(v)); }
+
+  void erase(long key) { list.erase(key); }
+};
+
+constexpr long keys = 32;
+
+template <typename List>
+void run(const char *name, int threads, long ops) {
+  List l;
+  for (long k = 0; k < keys; k += 2) {
+    l.insert(k, lockfree::make_shared<long>(k));
+  }
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int t) {
+    std::mt19937_64 rng(t);
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      switch (rng() % 200) {
+      case 0:
+        l.insert(rng() % keys, lockfree::make_shared<long>(i));
+        break;
+      case 1:
+        l.erase(rng() % keys);
+        break;
+      default:
+        sum += l.visit();
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 18);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run<lockfree_list>("ordered_list", threads, ops);
+    run<mutex_list>("mutex std::list", threads, ops);
+    run<shared_mutex_vector>("shared_mutex sorted vector", threads, ops);
+  }
+}
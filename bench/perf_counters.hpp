@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Optional perf_event_open counters around bench::run(). BENCH_PERF=1 turns
+// them on. BENCH_PERF_RAW=name:0xCONFIG adds a model-specific raw event, e.g.
+// hitm:0x04d2 for loads that hit a modified line in another core's cache
+// (MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM on Skylake, .XSNP_FWD on Ice Lake).
+// Events the kernel refuses are left out with a note on stderr, so a
+// container or VM without a PMU still gets the software ones or wall-clock
+// numbers only.
+
+namespace bench {
+
+class perf_counters {
+public:
+  static perf_counters &get() {
+    static perf_counters instance;
+    return instance;
+  }
+
+  bool enabled() const { return !events_.empty(); }
+
+  // Opens the counters, stopped, for the calling thread and every thread it
+  // creates from now on.
+  void open() {
+#ifdef __linux__
+    for (auto &e : events_) {
+      e.fd = open_event(e, true);
+    }
+#endif
+  }
+
+  void start() {
+#ifdef __linux__
+    for (auto &e : events_) {
+      if (e.fd >= 0) {
+        ioctl(e.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(e.fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  // Stops and reads the counters. Threads they followed must have exited,
+  // since their counts only join the parent's then.
+  void stop() {
+#ifdef __linux__
+    for (auto &e : events_) {
+      e.value = -1;
+      if (e.fd < 0) {
+        continue;
+      }
+      ioctl(e.fd, PERF_EVENT_IOC_DISABLE, 0);
+      std::uint64_t v[3]; // value, time enabled, time running
+      if (read(e.fd, v, sizeof(v)) == sizeof(v) && v[2] > 0) {
+        // Scales up for the share of time the PMU multiplexed it out.
+        e.value = double(v[0]) * double(v[1]) / double(v[2]);
+      }
+      close(e.fd);
+      e.fd = -1;
+    }
+#endif
+  }
+
+  void header() const { std::fputs(header_text().c_str(), stdout); }
+
+  // The last run's counts per operation; "-" where a read failed. Each run
+  // is reported once.
+  void report(long ops) { std::fputs(report_text(ops).c_str(), stdout); }
+
+  // The same columns as text, for benchmarks that print them elsewhere too.
+  std::string header_text() const {
+    std::string s;
+    for (auto &e : events_) {
+      s += format(" %11s", (e.name + "/op").c_str());
+    }
+    return s;
+  }
+
+  std::string report_text(long ops) {
+    std::string s;
+    for (auto &e : events_) {
+      if (e.value < 0) {
+        s += format(" %11s", "-");
+      } else {
+        s += format(" %11.4g", e.value / double(ops));
+      }
+      e.value = -1;
+    }
+    return s;
+  }
+
+private:
+  struct event {
+    std::string name;
+    std::uint32_t type;
+    std::uint64_t config;
+    int fd = -1;
+    double value = -1;
+  };
+
+  std::vector<event> events_;
+
+  template <typename... Args>
+  static std::string format(const char *fmt, Args... args) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), fmt, args...);
+    return buf;
+  }
+
+  perf_counters() {
+    const char *on = std::getenv("BENCH_PERF");
+    if (!on || !*on || std::strcmp(on, "0") == 0) {
+      return;
+    }
+#ifdef __linux__
+    auto cache = [](std::uint64_t cache, std::uint64_t result) {
+      return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | result << 16;
+    };
+    std::vector<event> wanted = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"l1d_miss", PERF_TYPE_HW_CACHE,
+         cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {"llc_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {"br_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {"ctx_sw", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+    if (const char *raw = std::getenv("BENCH_PERF_RAW")) {
+      const char *colon = std::strchr(raw, ':');
+      if (colon) {
+        wanted.push_back({std::string(raw, colon), PERF_TYPE_RAW,
+                          std::strtoull(colon + 1, nullptr, 0)});
+      } else {
+        std::fprintf(stderr, "bench: BENCH_PERF_RAW wants name:config\n");
+      }
+    }
+    // Keeps what the kernel accepts.
+    for (auto &e : wanted) {
+      int fd = open_event(e, false);
+      if (fd < 0) {
+        std::fprintf(stderr, "bench: perf event %s unavailable: %s\n",
+                     e.name.c_str(), std::strerror(errno));
+        continue;
+      }
+      close(fd);
+      events_.push_back(e);
+    }
+#else
+    std::fprintf(stderr, "bench: perf counters need Linux\n");
+#endif
+  }
+
+#ifdef __linux__
+  static int open_event(const event &e, bool inherit) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = e.type;
+    attr.config = e.config;
+    attr.disabled = 1;
+    attr.inherit = inherit;
+    // Context switches happen in the kernel.
+    attr.exclude_kernel = e.type != PERF_TYPE_SOFTWARE;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+};
+
+} // namespace bench
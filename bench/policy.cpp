@@ -0,0 +1,51 @@
+#include <cstdio>
+
+#include "bench.hpp"
+#include "shared_ptr.hpp"
+
+// One thread making an object, copying the pointer a few times and dropping
+// everything, under every combination of counter, weak support and storage.
+// The first row is shared_ptr's default_policy.
+
+struct Payload {
+  int value = 0;
+};
+
+template <typename Policy> void run(const char *name, long ops) {
+  double secs = bench::run(1, [&](int) {
+    for (long i = 0; i < ops; ++i) {
+      auto p = lockfree::make_basic_shared<Payload, Policy>();
+      auto a = p;
+      auto b = a;
+      auto c = b;
+      c->value = int(i);
+    }
+  });
+  bench::report(name, 1, ops, secs);
+}
+
+template <typename Counter, bool Weak, typename Storage>
+using policy = lockfree::shared_policy<Counter, Weak, Storage>;
+
+using acq_rel = lockfree::atomic_counter<std::memory_order_acq_rel>;
+using release = lockfree::atomic_counter<std::memory_order_release>;
+using plain = lockfree::plain_counter;
+using separate = lockfree::separate_storage;
+using inline_ = lockfree::inline_storage<>;
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+  bench::header();
+  run<policy<acq_rel, true, separate>>("acq_rel weak separate", ops);
+  run<policy<acq_rel, true, inline_>>("acq_rel weak inline", ops);
+  run<policy<acq_rel, false, separate>>("acq_rel separate", ops);
+  run<policy<acq_rel, false, inline_>>("acq_rel inline", ops);
+  run<policy<release, true, separate>>("release weak separate", ops);
+  run<policy<release, true, inline_>>("release weak inline", ops);
+  run<policy<release, false, separate>>("release separate", ops);
+  run<policy<release, false, inline_>>("release inline", ops);
+  run<policy<plain, true, separate>>("plain weak separate", ops);
+  run<policy<plain, true, inline_>>("plain weak inline", ops);
+  run<policy<plain, false, separate>>("plain separate", ops);
+  run<policy<plain, false, inline_>>("plain inline", ops);
+}
@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <mutex>
+#include <queue>
+#include <string>
+
+#include "bench.hpp"
+#include "queue.hpp"
+
+// Producers push their enqueue timestamp, consumers record how long each item
+// sat in the queue. Compares lockfree::queue with a std::queue guarded by a
+// std::mutex at several producer:consumer ratios.
+
+struct mutex_queue {
+  std::mutex m;
+  std::queue<long> q;
+
+  void push(long v) {
+    std::lock_guard lk(m);
+    q.push(v);
+  }
+
+  std::optional<long> try_pop() {
+    std::lock_guard lk(m);
+    if (q.empty()) {
+      return std::nullopt;
+    }
+    long v = q.front();
+    q.pop();
+    return v;
+  }
+};
+
+template <typename Queue>
+void run(const char *name, int producers, int consumers, long items) {
+  Queue q;
+  long per_producer = items / producers;
+  long total = per_producer * producers;
+  std::atomic<long> consumed = 0;
+  std::vector<std::vector<long>> latencies(consumers);
+
+  double secs = bench::run(producers + consumers, [&](int t) {
+    if (t < producers) {
+      for (long i = 0; i < per_producer; ++i) {
+        q.push(bench::now_ns());
+      }
+      return;
+    }
+    auto &samples = latencies[t - producers];
+    while (consumed.load(std::memory_order_relaxed) < total) {
+      if (auto v = q.try_pop()) {
+        consumed.fetch_add(1, std::memory_order_relaxed);
+        samples.push_back(bench::now_ns() - *v);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::vector<long> all;
+  for (auto &l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::string label =
+      std::string(name) + " " + std::to_string(producers) + ":" +
+      std::to_string(consumers);
+  bench::report(label.c_str(), producers + consumers, total, secs);
+  bench::report_latency(label.c_str(), all);
+}
+
+int main(int argc, char **argv) {
+  long items = bench::total_ops(argc, argv, 1 << 19);
+  constexpr int n = 4;
+  const std::pair<int, int> ratios[] = {{1, 1}, {1, n}, {n, 1}, {n, n}};
+  bench::header();
+  for (auto [producers, consumers] : ratios) {
+    run<lockfree::queue<long>>("lockfree::queue", producers, consumers,
+                               items);
+    run<mutex_queue>("mutex std::queue", producers, consumers, items);
+  }
+}
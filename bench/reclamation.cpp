@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "bench.hpp"
+#include "ebr_domain.hpp"
+#include "hazard_pointer.hpp"
+#include "ibr_domain.hpp"
+
+// Every thread reads a shared pointer under protection, swaps in a fresh
+// object and retires the old one, so the retire rate is as high as it gets.
+// Reports throughput and the most objects ever waiting in limbo.
+
+struct object {
+  long payload[4] = {};
+};
+
+struct ibr_object : lockfree::ibr_domain::object {
+  long payload[4] = {};
+};
+
+std::atomic<long> peak_limbo = 0;
+
+void note_limbo(long n) {
+  long peak = peak_limbo.load(std::memory_order_relaxed);
+  while (n > peak && !peak_limbo.compare_exchange_weak(peak, n)) {
+  }
+}
+
+void report_limbo(const char *name) {
+  std::printf("%-28s %8s peak limbo=%ld objects\n", name, "",
+              peak_limbo.load());
+  std::fflush(stdout);
+}
+
+void run_ebr(int threads, long ops) {
+  lockfree::ebr_domain domain;
+  std::atomic<object *> shared{new object};
+  peak_limbo = 0;
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    auto h = domain.register_thread();
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      {
+        auto g = h.pin();
+        sum += shared.load(std::memory_order_acquire)->payload[0];
+      }
+      h.retire(shared.exchange(new object, std::memory_order_acq_rel));
+      if (i % 256 == 0) {
+        note_limbo(domain.limbo_size());
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report("ebr_domain", threads, per_thread * threads, secs);
+  report_limbo("ebr_domain");
+  delete shared.load();
+}
+
+void run_ibr(int threads, long ops) {
+  lockfree::ibr_domain domain;
+  std::atomic<ibr_object *> shared{new ibr_object};
+  peak_limbo = 0;
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    auto h = domain.register_thread();
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      {
+        auto g = h.pin();
+        sum += h.protect(shared)->payload[0];
+      }
+      h.retire(shared.exchange(new ibr_object, std::memory_order_acq_rel));
+      if (i % 256 == 0) {
+        note_limbo(domain.limbo_size());
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report("ibr_domain", threads, per_thread * threads, secs);
+  report_limbo("ibr_domain");
+  delete shared.load();
+}
+
+void run_hazard_pointers(int threads, long ops) {
+  std::atomic<object *> shared{new object};
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      {
+        lockfree::hazard_pointer hp;
+        sum += hp.protect(shared)->payload[0];
+      }
+      lockfree::hazard_pointer_domain::global().retire(
+          shared.exchange(new object, std::memory_order_acq_rel),
+          [](void *p) { delete static_cast<object *>(p); });
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report("hazard_pointer_domain", threads, per_thread * threads, secs);
+  delete shared.load();
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 20);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run_ebr(threads, ops);
+    run_ibr(threads, ops);
+    run_hazard_pointers(threads, ops);
+  }
+}
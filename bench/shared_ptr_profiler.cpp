@@ -0,0 +1,45 @@
+#include <cstdio>
+
+#include "bench.hpp"
+#include "shared_ptr.hpp"
+
+// Creates and drops shared objects as fast as possible. bench_shared_ptr_
+// profiler has the profiler compiled in and runs it off and at two rates;
+// bench_shared_ptr_profiler_off is the same loop without it.
+
+struct Entry {
+  long key;
+  char value[56] = {};
+};
+
+void run(const char *name, int threads, long ops) {
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      auto p = lockfree::make_shared<Entry>(lockfree::packed_layout, Entry{i});
+      sum += p->key;
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+#ifdef LOCKFREE_PROFILE_SHARED
+    using lockfree::shared_ptr_profiler;
+    shared_ptr_profiler::set_sample_rate(0);
+    run("rate_0", threads, ops);
+    shared_ptr_profiler::set_sample_rate(4096);
+    run("rate_4096", threads, ops);
+    shared_ptr_profiler::set_sample_rate(256);
+    run("rate_256", threads, ops);
+#else
+    run("compiled_out", threads, ops);
+#endif
+  }
+}
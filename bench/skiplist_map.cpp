@@ -0,0 +1,112 @@
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "bench.hpp"
+#include "skiplist_map.hpp"
+
+// Point lookups and short range scans (90%) mixed with inserts and erases
+// (10%) over a prepopulated key range. Compares lockfree::skiplist_map with
+// a std::map guarded by a std::mutex.
+
+using value_ptr = lockfree::shared_ptr<long>;
+
+struct mutex_map {
+  std::mutex m;
+  std::map<long, value_ptr> map;
+
+  value_ptr find(long key) {
+    std::lock_guard lk(m);
+    auto it = map.find(key);
+    return it == map.end() ? nullptr : it->second;
+  }
+
+  long scan(long lo, long hi) {
+    std::lock_guard lk(m);
+    long sum = 0;
+    for (auto it = map.lower_bound(lo); it != map.end() && it->first < hi;
+         ++it) {
+      sum += *it->second;
+    }
+    return sum;
+  }
+
+  void insert_or_assign(long key, value_ptr v) {
+    std::lock_guard lk(m);
+    map.insert_or_assign(key, std::move(v));
+  }
+
+  void erase(long key) {
+    std::lock_guard lk(m);
+    map.erase(key);
+  }
+};
+
+struct skiplist {
+  lockfree::skiplist_map<long, long> map;
+
+  value_ptr find(long key) { return map.find(key); }
+
+  long scan(long lo, long hi) {
+    long sum = 0;
+    for (auto [key, value] : map.scan(lo, hi)) {
+      sum += *value;
+    }
+    return sum;
+  }
+
+  void insert_or_assign(long key, value_ptr v) {
+    map.insert_or_assign(key, std::move(v));
+  }
+
+  void erase(long key) { map.erase(key); }
+};
+
+constexpr long keys = 1 << 14;
+constexpr long range_width = 32;
+
+template <typename Map>
+void run(const char *name, bool ranges, int threads, long ops) {
+  Map m;
+  for (long k = 0; k < keys; ++k) {
+    m.insert_or_assign(k, lockfree::make_shared<long>(k));
+  }
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int t) {
+    std::mt19937_64 rng(t);
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      long key = rng() % keys;
+      switch (rng() % 20) {
+      case 0:
+        m.insert_or_assign(key, lockfree::make_shared<long>(i));
+        break;
+      case 1:
+        m.erase(key);
+        break;
+      default:
+        if (ranges) {
+          sum += m.scan(key, key + range_width);
+        } else if (auto v = m.find(key)) {
+          sum += *v;
+        }
+      }
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  std::string label = std::string(name) + (ranges ? " range" : " point");
+  bench::report(label.c_str(), threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 17);
+  bench::header();
+  for (bool ranges : {false, true}) {
+    for (int threads : bench::thread_counts) {
+      run<skiplist>("skiplist_map", ranges, threads, ops);
+      run<mutex_map>("mutex std::map", ranges, threads, ops);
+    }
+  }
+}
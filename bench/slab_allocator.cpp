@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstdio>
+#include <malloc.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "shared_ptr.hpp"
+
+// Control block allocation through slab_allocator (bench_slab_allocator) or
+// glibc malloc (bench_slab_allocator_off, built with -DLOCKFREE_NO_SLAB).
+//
+// The timed part has every thread replace the oldest of its last `window`
+// objects on each operation, with the header plus deleter block of
+// shared_ptr(new T) and with make_shared(packed_layout) blocks holding T
+// inline. Then, for fragmentation, threads make a mix of sizes, drop a
+// random 90% and hand the rest to the main thread, which reports what the
+// heap still holds per survivor.
+
+constexpr int window = 64;
+
+template <int Size> struct Obj {
+  unsigned char bytes[Size] = {};
+};
+
+template <typename Make>
+void run(const std::string &name, int threads, long ops, Make make) {
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    std::vector<decltype(make())> live(window);
+    long sum = 0;
+    for (long i = 0; i < per_thread; ++i) {
+      auto &p = live[i % window];
+      p = make();
+      sum += p->bytes[0];
+    }
+    volatile long sink = sum;
+    (void)sink;
+  });
+  bench::report(name.c_str(), threads, per_thread * threads, secs);
+}
+
+template <int Size> void run_packed(int threads, long ops) {
+  run("make_shared(packed) " + std::to_string(Size), threads, ops,
+      [] { return lockfree::make_shared<Obj<Size>>(lockfree::packed_layout); });
+}
+
+// What each churn thread keeps.
+struct survivors {
+  std::vector<lockfree::shared_ptr<Obj<16>>> small;
+  std::vector<lockfree::shared_ptr<Obj<48>>> medium;
+  std::vector<lockfree::shared_ptr<Obj<240>>> large;
+  std::vector<lockfree::shared_ptr<Obj<32>>> separate;
+
+  long count() const {
+    return long(small.size() + medium.size() + large.size() +
+                separate.size());
+  }
+};
+
+template <typename V> void keep_tenth(V &v, std::minstd_rand &rng) {
+  std::shuffle(v.begin(), v.end(), rng);
+  v.resize(v.size() / 10);
+  v.shrink_to_fit();
+}
+
+long heap_held() {
+  struct mallinfo2 m = mallinfo2();
+  return long(m.arena + m.hblkhd);
+}
+
+void churn(int threads, long objects) {
+  long before = heap_held();
+  std::vector<survivors> kept(threads);
+  std::vector<std::thread> ts;
+  for (int t = 0; t < threads; ++t) {
+    ts.emplace_back([&, t] {
+      std::minstd_rand rng(t + 1);
+      survivors &s = kept[t];
+      using lockfree::packed_layout;
+      for (long i = 0; i < objects / threads; ++i) {
+        switch (rng() % 4) {
+        case 0:
+          s.small.push_back(lockfree::make_shared<Obj<16>>(packed_layout));
+          break;
+        case 1:
+          s.medium.push_back(lockfree::make_shared<Obj<48>>(packed_layout));
+          break;
+        case 2:
+          s.large.push_back(lockfree::make_shared<Obj<240>>(packed_layout));
+          break;
+        default:
+          s.separate.push_back(lockfree::shared_ptr<Obj<32>>(new Obj<32>));
+        }
+      }
+      keep_tenth(s.small, rng);
+      keep_tenth(s.medium, rng);
+      keep_tenth(s.large, rng);
+      keep_tenth(s.separate, rng);
+    });
+  }
+  for (auto &t : ts) {
+    t.join();
+  }
+  long live = 0;
+  for (auto &s : kept) {
+    live += s.count();
+  }
+  long held = heap_held() - before;
+  std::printf("churn: %ld made, %ld live, heap holds %ld KiB, %.1f B/live",
+              objects, live, held / 1024, double(held) / double(live));
+#ifdef LOCKFREE_HAVE_SLAB
+  std::printf(", slabs %zu KiB",
+              lockfree::slab_allocator::reserved_bytes() / 1024);
+#endif
+  std::printf("\n");
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+#ifdef LOCKFREE_HAVE_SLAB
+  std::printf("# control blocks from slab_allocator\n");
+#else
+  std::printf("# control blocks from operator new\n");
+#endif
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    run("shared_ptr(new T)", threads, ops,
+        [] { return lockfree::shared_ptr<Obj<16>>(new Obj<16>); });
+    run_packed<16>(threads, ops);
+    run_packed<64>(threads, ops);
+    run_packed<240>(threads, ops);
+  }
+  churn(4, ops / 4);
+}
@@ -0,0 +1,59 @@
+#include <mutex>
+#include <stack>
+
+#include "bench.hpp"
+#include "stack.hpp"
+
+// Each thread alternates push and pop. Compares lockfree::stack with a
+// std::stack guarded by a std::mutex.
+
+struct mutex_stack {
+  std::mutex m;
+  std::stack<int> s;
+
+  void push(int v) {
+    std::lock_guard lk(m);
+    s.push(v);
+  }
+
+  bool try_pop(int &v) {
+    std::lock_guard lk(m);
+    if (s.empty()) {
+      return false;
+    }
+    v = s.top();
+    s.pop();
+    return true;
+  }
+};
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 20);
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    long per_thread = ops / threads / 2;
+    {
+      lockfree::stack<int> s;
+      double secs = bench::run(threads, [&](int t) {
+        for (long i = 0; i < per_thread; ++i) {
+          s.push(t);
+          s.try_pop();
+        }
+      });
+      bench::report("lockfree::stack", threads, per_thread * threads * 2,
+                    secs);
+    }
+    {
+      mutex_stack s;
+      double secs = bench::run(threads, [&](int t) {
+        int v;
+        for (long i = 0; i < per_thread; ++i) {
+          s.push(t);
+          s.try_pop(v);
+        }
+      });
+      bench::report("mutex std::stack", threads, per_thread * threads * 2,
+                    secs);
+    }
+  }
+}
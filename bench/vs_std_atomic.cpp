@@ -0,0 +1,199 @@
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+#include "bench.hpp"
+
+// The same workloads against lockfree::atomic_shared_ptr and libstdc++'s
+// std::atomic<std::shared_ptr>:
+//   load_heavy   1 in 64 operations stores, the rest load and read
+//   store_heavy  3 in 4 operations store, the rest load and read
+//   cas_counter  load, then CAS in a copy incremented by one
+//   pubsub       one publisher every 50us; latency is how long until a
+//                subscriber sees a value, throughput counts subscriber loads
+// Latency percentiles come from timing every 16th operation. Results go to
+// stdout and to argv[2] (default bench_vs_std_atomic.txt), one line per
+// workload, implementation and thread count, so runs can be diffed.
+
+struct Payload {
+  long value;
+  long published_ns;
+};
+
+struct ours {
+  static constexpr const char *name = "lockfree";
+  using ptr = lockfree::shared_ptr<Payload>;
+  using atomic = lockfree::atomic_shared_ptr<Payload>;
+
+  static ptr make(long value, long stamp = 0) {
+    return lockfree::make_shared<Payload>(lockfree::packed_layout,
+                                          Payload{value, stamp});
+  }
+};
+
+struct standard {
+  static constexpr const char *name = "std";
+  using ptr = std::shared_ptr<Payload>;
+  using atomic = std::atomic<std::shared_ptr<Payload>>;
+
+  static ptr make(long value, long stamp = 0) {
+    return std::make_shared<Payload>(Payload{value, stamp});
+  }
+};
+
+std::FILE *out_file;
+
+// Prints to stdout and the results file.
+template <typename... Args> void emit(const char *fmt, Args... args) {
+  std::printf(fmt, args...);
+  std::fprintf(out_file, fmt, args...);
+}
+
+void report(const char *workload, const char *impl, int threads, long ops,
+            double secs, std::vector<long> &latencies) {
+  emit("%-12s %-9s %8d %14.0f %10.1f %8ld %8ld %8ld%s\n", workload, impl,
+       threads, ops / secs, secs * 1e9 / ops,
+       bench::percentile(latencies, 50), bench::percentile(latencies, 99),
+       bench::percentile(latencies, 99.9),
+       bench::perf_counters::get().report_text(ops).c_str());
+  std::fflush(stdout);
+}
+
+// Runs `op(rng)` per_thread times on each thread, timing every 16th call.
+template <typename Op>
+void measure(const char *workload, const char *impl, int threads, long ops,
+             Op op) {
+  long per_thread = ops / threads;
+  std::vector<std::vector<long>> samples(threads);
+  double secs = bench::run(threads, [&](int t) {
+    unsigned x = 2463534242u + t;
+    auto &mine = samples[t];
+    mine.reserve(per_thread / 16 + 1);
+    for (long i = 0; i < per_thread; ++i) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      if (i % 16 == 0) {
+        long start = bench::now_ns();
+        op(x);
+        mine.push_back(bench::now_ns() - start);
+      } else {
+        op(x);
+      }
+    }
+  });
+  std::vector<long> all;
+  for (auto &s : samples) {
+    all.insert(all.end(), s.begin(), s.end());
+  }
+  report(workload, impl, threads, per_thread * threads, secs, all);
+}
+
+template <typename Impl> void run_mixed(const char *name, int threads,
+                                        long ops, unsigned store_in_64) {
+  typename Impl::atomic a(Impl::make(1));
+  // Stores publish copies of these, so allocation isn't what's measured.
+  std::vector<typename Impl::ptr> pool;
+  for (int i = 0; i < 64; ++i) {
+    pool.push_back(Impl::make(i));
+  }
+  std::atomic<long> sink = 0;
+  measure(name, Impl::name, threads, ops, [&](unsigned x) {
+    if (x % 64 < store_in_64) {
+      a.store(pool[x / 64 % 64]);
+    } else {
+      auto p = a.load();
+      if (p->value < 0) {
+        sink.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  });
+}
+
+template <typename Impl> void run_cas_counter(int threads, long ops) {
+  typename Impl::atomic a(Impl::make(0));
+  measure("cas_counter", Impl::name, threads, ops, [&](unsigned) {
+    auto cur = a.load();
+    auto next = Impl::make(cur->value + 1);
+    while (!a.compare_exchange_weak(cur, next)) {
+      next->value = cur->value + 1;
+    }
+  });
+  if (a.load()->value != ops / threads * threads) {
+    std::fprintf(stderr, "cas_counter lost updates\n");
+    std::exit(1);
+  }
+}
+
+template <typename Impl> void run_pubsub(int subscribers, long messages) {
+  typename Impl::atomic a(Impl::make(0, bench::now_ns()));
+  std::atomic<bool> done = false;
+  std::atomic<long> loads = 0;
+  std::vector<std::vector<long>> samples(subscribers);
+  double secs = bench::run(subscribers + 1, [&](int t) {
+    if (t == subscribers) {
+      for (long i = 1; i <= messages; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        a.store(Impl::make(i, bench::now_ns()));
+      }
+      done = true;
+      return;
+    }
+    long n = 0, seen = 0;
+    while (!done.load(std::memory_order_relaxed)) {
+      auto p = a.load();
+      ++n;
+      if (p->value != seen) {
+        samples[t].push_back(bench::now_ns() - p->published_ns);
+        seen = p->value;
+      }
+    }
+    loads += n;
+  });
+  std::vector<long> all;
+  for (auto &s : samples) {
+    all.insert(all.end(), s.begin(), s.end());
+  }
+  report("pubsub", Impl::name, subscribers, loads, secs, all);
+}
+
+template <typename Impl> void run_all(int threads, long ops) {
+  run_mixed<Impl>("load_heavy", threads, ops, 1);
+  run_mixed<Impl>("store_heavy", threads, ops, 48);
+  run_cas_counter<Impl>(threads, ops / 4);
+  run_pubsub<Impl>(threads, 1000);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 20);
+  const char *path = argc > 2 ? argv[2] : "bench_vs_std_atomic.txt";
+  out_file = std::fopen(path, "w");
+  if (!out_file) {
+    std::perror(path);
+    return 1;
+  }
+  emit("# ops=%ld hardware_threads=%u compiler=%s\n", ops,
+       std::thread::hardware_concurrency(), __VERSION__);
+  ours::atomic a;
+  standard::atomic s;
+  emit("# lockfree::atomic_shared_ptr: is_always_lock_free=%d "
+       "is_lock_free=%d\n",
+       int(ours::atomic::is_always_lock_free), int(a.is_lock_free()));
+  emit("# std::atomic<std::shared_ptr>: is_always_lock_free=%d "
+       "is_lock_free=%d\n",
+       int(standard::atomic::is_always_lock_free), int(s.is_lock_free()));
+  emit("%-12s %-9s %8s %14s %10s %8s %8s %8s%s\n", "workload", "impl",
+       "threads", "ops/s", "ns/op", "p50ns", "p99ns", "p99.9ns",
+       bench::perf_counters::get().header_text().c_str());
+  for (int threads : bench::thread_counts) {
+    run_all<ours>(threads, ops);
+    run_all<standard>(threads, ops);
+  }
+  std::fclose(out_file);
+  std::printf("results written to %s\n", path);
+}
@@ -0,0 +1,60 @@
+#include <cstdio>
+
+#include "bench.hpp"
+#include "shared_ptr.hpp"
+
+// What the weak count costs: block sizes, the make/drop cycle (last release
+// is one RMW without it) and copy/drop of a shared reference.
+
+struct Observed {
+  long value = 0;
+};
+
+struct Lean {
+  long value = 0;
+};
+
+template <> struct lockfree::disable_weak_ptr<Lean> : std::true_type {};
+
+template <typename T> void footprint(const char *name) {
+  using inplace = lockfree::detail::control_block_inplace<
+      T, lockfree::packed_layout_t>;
+  using with_ptr = lockfree::detail::control_block_with_ptr<T>;
+  std::printf("%-28s inplace=%zuB with_ptr=%zuB\n", name, sizeof(inplace),
+              sizeof(with_ptr));
+}
+
+template <typename T> void make_drop(const char *name, int threads, long ops) {
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    for (long i = 0; i < per_thread; ++i) {
+      auto p = lockfree::make_shared<T>(lockfree::packed_layout);
+      p->value = i;
+    }
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+template <typename T> void copy_drop(const char *name, int threads, long ops) {
+  auto p = lockfree::make_shared<T>(lockfree::packed_layout);
+  long per_thread = ops / threads;
+  double secs = bench::run(threads, [&](int) {
+    for (long i = 0; i < per_thread; ++i) {
+      lockfree::shared_ptr<T> copy = p;
+    }
+  });
+  bench::report(name, threads, per_thread * threads, secs);
+}
+
+int main(int argc, char **argv) {
+  long ops = bench::total_ops(argc, argv, 1 << 22);
+  footprint<Observed>("footprint weak");
+  footprint<Lean>("footprint no weak");
+  bench::header();
+  for (int threads : bench::thread_counts) {
+    make_drop<Observed>("make/drop weak", threads, ops);
+    make_drop<Lean>("make/drop no weak", threads, ops);
+    copy_drop<Observed>("copy/drop weak", threads, ops);
+    copy_drop<Lean>("copy/drop no weak", threads, ops);
+  }
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "shared_ptr.hpp"
+
+namespace lockfree {
+
+// A bump allocator for objects that all die together, such as a request's
+// object graph. make_shared_in() puts the control block and the object in
+// it, and reset() destroys every object in reverse order of creation and
+// drops the memory in one step, keeping one chunk for the next round.
+//
+// In release builds the blocks are immortal, so copying the pointers within
+// the request costs no RMW, and cycles between objects are fine. Nothing
+// may use them after reset(). Debug builds count references as usual, with
+// one held by the arena, and reset() asserts that once every object is
+// destroyed, no shared_ptr or weak_ptr outside them still holds one.
+//
+// Allocation isn't thread-safe; the pointers are, like any shared_ptr.
+class arena {
+public:
+  static constexpr ::std::size_t default_chunk_size = 64 * 1024;
+
+  explicit arena(::std::size_t chunk_size = default_chunk_size)
+      : chunk_size_(chunk_size) {}
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  ~arena() {
+    reset();
+    release(head_);
+  }
+
+  // Raw memory that lives until the next reset().
+  void *allocate(::std::size_t size, ::std::size_t align) {
+    auto p = (cur_ + align - 1) & ~::std::uintptr_t(align - 1);
+    if (!head_ || p + size > end_) {
+      grow(size + align);
+      p = (cur_ + align - 1) & ~::std::uintptr_t(align - 1);
+    }
+    cur_ = p + size;
+    return reinterpret_cast<void *>(p);
+  }
+
+  // Destroys every object made in the arena and frees all but the newest
+  // chunk.
+  void reset() {
+    for (cleanup *c = cleanups_; c; c = c->next) {
+      c->block->unprofile();
+      c->destroy(c->block);
+    }
+#ifndef NDEBUG
+    // Only the arena's own references are left unless something escaped.
+    for (cleanup *c = cleanups_; c; c = c->next) {
+      assert(c->block->load_use_count() == 1 &&
+             "shared_ptr outlived its arena");
+      auto w = c->block->weak();
+      assert((!w || atomic_counter<>::load(w->weak_count) == 1) &&
+             "weak_ptr outlived its arena");
+    }
+#endif
+    cleanups_ = nullptr;
+    if (head_) {
+      release(head_->next);
+      head_->next = nullptr;
+      cur_ = reinterpret_cast<::std::uintptr_t>(head_ + 1);
+      end_ = reinterpret_cast<::std::uintptr_t>(head_) + head_->size;
+    }
+  }
+
+  // Bytes of chunks currently held.
+  ::std::size_t capacity() const {
+    ::std::size_t n = 0;
+    for (chunk *c = head_; c; c = c->next) {
+      n += c->size;
+    }
+    return n;
+  }
+
+private:
+  template <class T, class... Args>
+  friend shared_ptr<T> make_shared_in(arena &a, Args &&...args);
+
+  struct alignas(detail::cache_line_size) chunk {
+    chunk *next;
+    ::std::size_t size;
+  };
+
+  // An object to destroy at reset(). Release builds skip trivially
+  // destructible ones unless the profiler may have sampled them.
+  struct cleanup {
+    void (*destroy)(detail::control_block *);
+    detail::control_block *block;
+    cleanup *next;
+  };
+
+  const ::std::size_t chunk_size_;
+  chunk *head_ = nullptr; // Newest first.
+  ::std::uintptr_t cur_ = 0;
+  ::std::uintptr_t end_ = 0;
+  cleanup *cleanups_ = nullptr; // Newest first.
+
+  // Starts a chunk that holds at least `size` more bytes.
+  void grow(::std::size_t size) {
+    ::std::size_t bytes = ::std::max(chunk_size_, sizeof(chunk) + size);
+    void *p = ::operator new(bytes,
+                             ::std::align_val_t(detail::cache_line_size));
+    auto c = ::new (p) chunk{head_, bytes};
+    head_ = c;
+    cur_ = reinterpret_cast<::std::uintptr_t>(c + 1);
+    end_ = reinterpret_cast<::std::uintptr_t>(c) + bytes;
+  }
+
+  static void release(chunk *c) {
+    while (c) {
+      chunk *next = c->next;
+      ::operator delete(c, ::std::align_val_t(detail::cache_line_size));
+      c = next;
+    }
+  }
+};
+
+// A shared_ptr to a T that lives in `a` until a.reset(); see arena.
+template <class T, class... Args>
+shared_ptr<T> make_shared_in(arena &a, Args &&...args) {
+  static_assert(!::std::is_array_v<T>);
+  static_assert(!destroy_in_background<::std::remove_cv_t<T>>::value,
+                "reset() frees arena objects at once, not in the background");
+  using block = detail::control_block_inplace<T, packed_layout_t>;
+#if defined(NDEBUG) && !defined(LOCKFREE_PROFILE_SHARED)
+  constexpr bool tracked = !::std::is_trivially_destructible_v<T>;
+#else
+  constexpr bool tracked = true;
+#endif
+  // Allocated first, so nothing can fail once the object exists.
+  void *c = tracked ? a.allocate(sizeof(arena::cleanup),
+                                 alignof(arena::cleanup))
+                    : nullptr;
+  void *p = a.allocate(sizeof(block), alignof(block));
+  auto b = ::new (p) block(::std::forward<Args>(args)...);
+#ifdef NDEBUG
+  b->make_immortal();
+#else
+  b->increment_use_count(); // The arena's own.
+#endif
+  if constexpr (tracked) {
+    a.cleanups_ = ::new (c) arena::cleanup{
+        [](detail::control_block *x) {
+          static_cast<block *>(x)->getptr()->~T();
+        },
+        b, a.cleanups_};
+  }
+  return detail::adopt_block<T, default_policy>(b);
+}
+
+} // namespace lockfree
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+
+#if defined(__linux__) && !defined(LOCKFREE_NO_MEMBARRIER)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define LOCKFREE_HAVE_MEMBARRIER 1
+#endif
+
+namespace lockfree::detail {
+
+// A pair of fences that order like two seq_cst fences when one side runs
+// light() and the other heavy(). light() is for the hot path: with Linux's
+// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) it's only a compiler barrier,
+// and heavy() makes every running thread of the process execute a full fence
+// instead. Where membarrier isn't available (old kernel, seccomp, another OS
+// or -DLOCKFREE_NO_MEMBARRIER) both are plain seq_cst fences.
+class asymmetric_fence {
+public:
+  static bool expedited() {
+    static const bool ok = register_process();
+    return ok;
+  }
+
+  static void light() {
+    if (expedited()) {
+      ::std::atomic_signal_fence(::std::memory_order_seq_cst);
+    } else {
+      ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    }
+  }
+
+  static void heavy() {
+#ifdef LOCKFREE_HAVE_MEMBARRIER
+    if (expedited()) {
+      // Can't fail once the process is registered.
+      [[maybe_unused]] long r =
+          ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+      assert(r == 0);
+      return;
+    }
+#endif
+    ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+  }
+
+private:
+  static bool register_process() {
+#ifdef LOCKFREE_HAVE_MEMBARRIER
+    long cmds = ::syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+    return cmds >= 0 && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+           ::syscall(SYS_membarrier,
+                     MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+    return false;
+#endif
+  }
+};
+
+} // namespace lockfree::detail
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "hazard_pointer.hpp"
+#include "shared_ptr.hpp"
+
+// The atomic holds a single control block pointer and owns one reference to
+// it. A reader publishes the pointer in a hazard slot before incrementing the
+// count; a writer retires the reference it replaced instead of dropping it
+// right away. That's the scheme from
+// https://github.com/DanielLiamAnderson/atomic_shared_ptr, with hazard
+// pointers as the deferred reclamation.
+
+namespace lockfree {
+
+namespace detail {
+// Owns a reference to `owner` but points at some other address. It lets an
+// aliasing shared_ptr be stored as a single control block pointer.
+struct control_block_alias : control_block {
+  control_block_alias(void *ptr, control_block *owner)
+      : ptr_(ptr), owner_(owner) {}
+
+  void *getaddr() override { return ptr_; }
+
+  weak_control_block *weak() override { return owner_->weak(); }
+
+private:
+  void *ptr_;
+  control_block *owner_;
+
+  void release() override {
+    owner_->decrement_use_count();
+    delete this;
+  }
+};
+
+// The parts of shared_ptr's internals the atomic pointers work with.
+template <typename T> struct shared_ptr_access {
+  using element_type = typename shared_ptr<T>::element_type;
+
+  static control_block *ctrl(const shared_ptr<T> &p) { return p.ctrl_; }
+
+  // A value is canonical if its control block alone can reproduce it.
+  static bool canonical(const shared_ptr<T> &p) {
+    return !p.ctrl_ || static_cast<const void *>(p.ptr_) == p.ctrl_->getaddr();
+  }
+
+  static bool equivalent(const shared_ptr<T> &a, const shared_ptr<T> &b) {
+    return a.ctrl_ == b.ctrl_ && a.ptr_ == b.ptr_;
+  }
+
+  // Turns `p` into a control block pointer that owns p's reference. An
+  // aliasing pointer is wrapped into a control_block_alias first.
+  static control_block *release(shared_ptr<T> &p) {
+    if (!canonical(p)) {
+      auto ptr = const_cast<void *>(static_cast<const void *>(p.ptr_));
+      auto alias = new control_block_alias(ptr, p.ctrl_);
+      p.clear();
+      return alias;
+    }
+    auto c = p.ctrl_;
+    p.clear();
+    return c;
+  }
+
+  static shared_ptr<T> adopt(control_block *c) {
+    if (!c) {
+      return nullptr;
+    }
+    return shared_ptr<T>(adopt_t{}, static_cast<element_type *>(c->getaddr()),
+                         c);
+  }
+
+  // Drops a reference once no reader can be about to increment it.
+  static void retire(control_block *c) {
+    if (c) {
+      hazard_pointer_domain::global().retire(c, [](void *p) {
+        static_cast<control_block *>(p)->decrement_use_count();
+      });
+    }
+  }
+};
+
+// The parts of weak_ptr's internals atomic_weak_ptr works with.
+template <typename T> struct weak_ptr_access {
+  using element_type = typename weak_ptr<T>::element_type;
+
+  static weak_control_block *ctrl(const weak_ptr<T> &p) { return p.ctrl_; }
+
+  static element_type *ptr(const weak_ptr<T> &p) { return p.ptr_; }
+
+  // As for shared_ptr. getaddr() is still valid once the object is gone.
+  static bool canonical(const weak_ptr<T> &p) {
+    return !p.ctrl_ || static_cast<const void *>(p.ptr_) == p.ctrl_->getaddr();
+  }
+
+  // Takes p's weak reference, leaving p empty.
+  static weak_control_block *release(weak_ptr<T> &p) {
+    p.ptr_ = nullptr;
+    return ::std::exchange(p.ctrl_, nullptr);
+  }
+
+  static weak_ptr<T> adopt(element_type *ptr, weak_control_block *c) {
+    weak_ptr<T> p;
+    p.ptr_ = ptr;
+    p.ctrl_ = c;
+    return p;
+  }
+};
+} // namespace detail
+
+template <typename T> class atomic_shared_ptr {
+  using access = detail::shared_ptr_access<T>;
+
+public:
+  using value_type = shared_ptr<T>;
+  using element_type = typename shared_ptr<T>::element_type;
+
+  static constexpr bool is_always_lock_free =
+      ::std::atomic<detail::control_block *>::is_always_lock_free;
+
+  constexpr atomic_shared_ptr() noexcept = default;
+
+  atomic_shared_ptr(shared_ptr<T> desired) : ctrl_(access::release(desired)) {}
+
+  atomic_shared_ptr(const atomic_shared_ptr &) = delete;
+  atomic_shared_ptr &operator=(const atomic_shared_ptr &) = delete;
+
+  // Nobody may be loading concurrently, so the reference is dropped directly.
+  ~atomic_shared_ptr() {
+    if (auto c = ctrl_.load(::std::memory_order_relaxed)) {
+      c->decrement_use_count();
+    }
+  }
+
+  void operator=(shared_ptr<T> desired) { store(::std::move(desired)); }
+
+  bool is_lock_free() const noexcept { return ctrl_.is_lock_free(); }
+
+  // The hazard pointer already orders the load, so `order` only exists for
+  // interface compatibility with std::atomic.
+  shared_ptr<T>
+  load(::std::memory_order order = ::std::memory_order_seq_cst) const {
+    (void)order;
+    hazard_pointer hp;
+    detail::control_block *c = hp.protect(ctrl_);
+    if (!c) {
+      return nullptr;
+    }
+    c->increment_use_count();
+    return access::adopt(c);
+  }
+
+  operator shared_ptr<T>() const { return load(); }
+
+  // Returns the stored pointer without touching the count. It stays valid for
+  // as long as `hp` protects it.
+  element_type *protect(hazard_pointer &hp) const {
+    detail::control_block *c = hp.protect(ctrl_);
+    return c ? static_cast<element_type *>(c->getaddr()) : nullptr;
+  }
+
+  void store(shared_ptr<T> desired,
+             ::std::memory_order order = ::std::memory_order_seq_cst) {
+    access::retire(ctrl_.exchange(access::release(desired), order));
+  }
+
+  shared_ptr<T>
+  exchange(shared_ptr<T> desired,
+           ::std::memory_order order = ::std::memory_order_seq_cst) {
+    detail::control_block *old =
+        ctrl_.exchange(access::release(desired), order);
+    // A reader may still be about to increment `old`, so the caller gets a
+    // fresh reference and the atomic's own one goes through retire().
+    if (old) {
+      old->increment_use_count();
+      access::retire(old);
+    }
+    return access::adopt(old);
+  }
+
+  // Takes the stored reference without deferring anything. Only valid when no
+  // other thread can reach this atomic, e.g. while destroying its owner.
+  shared_ptr<T> unsafe_take() noexcept {
+    return access::adopt(ctrl_.exchange(nullptr, ::std::memory_order_relaxed));
+  }
+
+  // Two values compare equal when they point at the same object and share the
+  // same control block. On failure `expected` receives the current value.
+  bool compare_exchange_weak(
+      shared_ptr<T> &expected, shared_ptr<T> desired,
+      ::std::memory_order success = ::std::memory_order_seq_cst,
+      ::std::memory_order failure = ::std::memory_order_seq_cst) {
+    detail::control_block *des = access::release(desired);
+    if (try_exchange(expected, des, success, failure)) {
+      return true;
+    }
+    desired = access::adopt(des);
+    expected = load();
+    return false;
+  }
+
+  bool compare_exchange_strong(
+      shared_ptr<T> &expected, shared_ptr<T> desired,
+      ::std::memory_order success = ::std::memory_order_seq_cst,
+      ::std::memory_order failure = ::std::memory_order_seq_cst) {
+    detail::control_block *des = access::release(desired);
+    while (!try_exchange(expected, des, success, failure)) {
+      shared_ptr<T> current = load();
+      if (!access::equivalent(current, expected)) {
+        expected = ::std::move(current);
+        desired = access::adopt(des);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Blocks until the stored value differs from `old`, compared like
+  // compare_exchange does, so an aliasing `old` returns right away. Sleeps in
+  // std::atomic::wait on the control block pointer, a futex on Linux. `old`
+  // keeps its block alive, so its address can't come back as another value
+  // in the meantime.
+  void wait(shared_ptr<T> old,
+            ::std::memory_order order = ::std::memory_order_seq_cst) const {
+    if (access::canonical(old)) {
+      ctrl_.wait(access::ctrl(old), order);
+    }
+  }
+
+  // Wake waiters after a store. Stores don't notify on their own.
+  void notify_one() noexcept { ctrl_.notify_one(); }
+
+  void notify_all() noexcept { ctrl_.notify_all(); }
+
+private:
+  ::std::atomic<detail::control_block *> ctrl_{nullptr};
+
+  // Single CAS attempt; on success the atomic owns `des` and the replaced
+  // reference is retired.
+  bool try_exchange(const shared_ptr<T> &expected, detail::control_block *des,
+                    ::std::memory_order success,
+                    ::std::memory_order failure) {
+    if (!access::canonical(expected)) {
+      // Stored values are always canonical, so this can never match.
+      return false;
+    }
+    detail::control_block *exp = access::ctrl(expected);
+    if (!ctrl_.compare_exchange_strong(exp, des, success, failure)) {
+      return false;
+    }
+    access::retire(exp);
+    return true;
+  }
+};
+
+// A weak_ptr that threads can load and replace concurrently. The atomic owns
+// one weak reference. A canonical value is stored as its bare control block
+// pointer; an aliasing one as a tagged alias_node that owns the reference.
+// Readers protect the word with a hazard pointer and increment the weak
+// count, so load() never allocates and neither does lock() on the result.
+template <typename T> class atomic_weak_ptr {
+  using access = detail::weak_ptr_access<T>;
+
+public:
+  using value_type = weak_ptr<T>;
+  using element_type = typename weak_ptr<T>::element_type;
+
+  static constexpr bool is_always_lock_free =
+      ::std::atomic<::std::uintptr_t>::is_always_lock_free;
+
+  constexpr atomic_weak_ptr() noexcept = default;
+
+  atomic_weak_ptr(weak_ptr<T> desired) : word_(to_word(desired)) {}
+
+  atomic_weak_ptr(const atomic_weak_ptr &) = delete;
+  atomic_weak_ptr &operator=(const atomic_weak_ptr &) = delete;
+
+  // Nobody may be loading concurrently, so the reference is dropped directly.
+  ~atomic_weak_ptr() {
+    ::std::uintptr_t w = word_.load(::std::memory_order_relaxed);
+    if (w) {
+      reclaimer(w)(to_addr(w));
+    }
+  }
+
+  void operator=(weak_ptr<T> desired) { store(::std::move(desired)); }
+
+  bool is_lock_free() const noexcept { return word_.is_lock_free(); }
+
+  // See atomic_shared_ptr::load() about `order`.
+  weak_ptr<T>
+  load(::std::memory_order order = ::std::memory_order_seq_cst) const {
+    (void)order;
+    hazard_pointer hp;
+    return share(hp.protect(word_, to_addr));
+  }
+
+  operator weak_ptr<T>() const { return load(); }
+
+  void store(weak_ptr<T> desired,
+             ::std::memory_order order = ::std::memory_order_seq_cst) {
+    retire(word_.exchange(to_word(desired), order));
+  }
+
+  // Like atomic_shared_ptr::exchange(), the caller gets a fresh reference.
+  weak_ptr<T>
+  exchange(weak_ptr<T> desired,
+           ::std::memory_order order = ::std::memory_order_seq_cst) {
+    ::std::uintptr_t old = word_.exchange(to_word(desired), order);
+    weak_ptr<T> result = share(old);
+    retire(old);
+    return result;
+  }
+
+  // Two values compare equal when they point at the same address through the
+  // same control block. Unlike atomic_shared_ptr, that includes aliasing
+  // values. On failure `expected` receives the current value.
+  bool compare_exchange_weak(
+      weak_ptr<T> &expected, weak_ptr<T> desired,
+      ::std::memory_order success = ::std::memory_order_seq_cst,
+      ::std::memory_order failure = ::std::memory_order_seq_cst) {
+    ::std::uintptr_t des = to_word(desired);
+    if (try_exchange(expected, des, success, failure)) {
+      return true;
+    }
+    desired = from_word(des);
+    expected = load();
+    return false;
+  }
+
+  bool compare_exchange_strong(
+      weak_ptr<T> &expected, weak_ptr<T> desired,
+      ::std::memory_order success = ::std::memory_order_seq_cst,
+      ::std::memory_order failure = ::std::memory_order_seq_cst) {
+    ::std::uintptr_t des = to_word(desired);
+    while (!try_exchange(expected, des, success, failure)) {
+      weak_ptr<T> current = load();
+      if (!equivalent(current, expected)) {
+        expected = ::std::move(current);
+        desired = from_word(des);
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  static constexpr ::std::uintptr_t alias_bit = 1;
+
+  // An aliasing value. Never changes once stored.
+  struct alias_node {
+    element_type *ptr;
+    detail::weak_control_block *owner; // Holds a weak reference.
+  };
+
+  ::std::atomic<::std::uintptr_t> word_{0};
+
+  static void *to_addr(::std::uintptr_t w) {
+    return reinterpret_cast<void *>(w & ~alias_bit);
+  }
+
+  // Turns `p` into a word that owns p's weak reference.
+  static ::std::uintptr_t to_word(weak_ptr<T> &p) {
+    if (!access::canonical(p)) {
+      auto node = new alias_node{access::ptr(p), nullptr};
+      node->owner = access::release(p);
+      return reinterpret_cast<::std::uintptr_t>(node) | alias_bit;
+    }
+    return reinterpret_cast<::std::uintptr_t>(access::release(p));
+  }
+
+  // The inverse of to_word(), for a word that was never published.
+  static weak_ptr<T> from_word(::std::uintptr_t w) {
+    if (w & alias_bit) {
+      auto node = static_cast<alias_node *>(to_addr(w));
+      weak_ptr<T> p = access::adopt(node->ptr, node->owner);
+      delete node;
+      return p;
+    }
+    auto c = static_cast<detail::weak_control_block *>(to_addr(w));
+    return c ? access::adopt(static_cast<element_type *>(c->getaddr()), c)
+             : weak_ptr<T>{};
+  }
+
+  // A new weak reference to the value of `w`, which must be protected or
+  // owned by the caller.
+  static weak_ptr<T> share(::std::uintptr_t w) {
+    if (w & alias_bit) {
+      auto node = static_cast<alias_node *>(to_addr(w));
+      node->owner->increment_weak_count();
+      return access::adopt(node->ptr, node->owner);
+    }
+    auto c = static_cast<detail::weak_control_block *>(to_addr(w));
+    if (!c) {
+      return {};
+    }
+    c->increment_weak_count();
+    return access::adopt(static_cast<element_type *>(c->getaddr()), c);
+  }
+
+  // Drops the reference a (non-null) word owns.
+  static hazard_pointer_domain::reclaim_fn reclaimer(::std::uintptr_t w) {
+    if (w & alias_bit) {
+      return [](void *p) {
+        auto node = static_cast<alias_node *>(p);
+        node->owner->decrement_weak_count();
+        delete node;
+      };
+    }
+    return [](void *p) {
+      static_cast<detail::weak_control_block *>(p)->decrement_weak_count();
+    };
+  }
+
+  // Drops the reference once no reader can be about to increment it.
+  static void retire(::std::uintptr_t w) {
+    if (w) {
+      hazard_pointer_domain::global().retire(to_addr(w), reclaimer(w));
+    }
+  }
+
+  static bool equivalent(const weak_ptr<T> &a, const weak_ptr<T> &b) {
+    return access::ctrl(a) == access::ctrl(b) &&
+           access::ptr(a) == access::ptr(b);
+  }
+
+  // Whether `w`, which must be protected, holds the value of `p`.
+  static bool holds(::std::uintptr_t w, const weak_ptr<T> &p) {
+    if (w & alias_bit) {
+      auto node = static_cast<alias_node *>(to_addr(w));
+      return node->owner == access::ctrl(p) && node->ptr == access::ptr(p);
+    }
+    return to_addr(w) == access::ctrl(p) && access::canonical(p);
+  }
+
+  // Single CAS attempt on the word that holds `expected`, if any. Aliasing
+  // values live in nodes of their own, so the word is read and compared by
+  // value first; the hazard pointer keeps its address from being reused.
+  bool try_exchange(const weak_ptr<T> &expected, ::std::uintptr_t des,
+                    ::std::memory_order success,
+                    ::std::memory_order failure) {
+    hazard_pointer hp;
+    ::std::uintptr_t exp = hp.protect(word_, to_addr);
+    if (!holds(exp, expected) ||
+        !word_.compare_exchange_strong(exp, des, success, failure)) {
+      return false;
+    }
+    retire(exp);
+    return true;
+  }
+};
+
+// An atomic_shared_ptr with a mark bit next to the pointer, for logical
+// deletion in Harris-style linked structures. The mark is not part of the
+// reference: setting it never touches the count.
+template <typename T> class atomic_markable_shared_ptr {
+  using access = detail::shared_ptr_access<T>;
+
+public:
+  using element_type = typename shared_ptr<T>::element_type;
+
+  // A value read by protect(). It holds no reference; the pointee stays alive
+  // for as long as the hazard pointer protects it.
+  class snapshot {
+  public:
+    snapshot() = default;
+
+    element_type *get() const noexcept { return ptr_; }
+
+    element_type *operator->() const noexcept { return ptr_; }
+
+    explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+    bool marked() const noexcept { return marked_; }
+
+    // A counted reference to the same object.
+    shared_ptr<T> share() const {
+      if (!ctrl_) {
+        return nullptr;
+      }
+      ctrl_->increment_use_count();
+      return access::adopt(ctrl_);
+    }
+
+  private:
+    friend class atomic_markable_shared_ptr;
+
+    detail::control_block *ctrl_ = nullptr;
+    element_type *ptr_ = nullptr;
+    bool marked_ = false;
+  };
+
+  constexpr atomic_markable_shared_ptr() noexcept = default;
+
+  atomic_markable_shared_ptr(const atomic_markable_shared_ptr &) = delete;
+  atomic_markable_shared_ptr &
+  operator=(const atomic_markable_shared_ptr &) = delete;
+
+  ~atomic_markable_shared_ptr() {
+    if (auto c = to_ctrl(word_.load(::std::memory_order_relaxed))) {
+      c->decrement_use_count();
+    }
+  }
+
+  shared_ptr<T> load(bool *marked = nullptr) const {
+    hazard_pointer hp;
+    ::std::uintptr_t w = hp.protect(word_, to_ctrl);
+    if (marked) {
+      *marked = w & mark_bit;
+    }
+    detail::control_block *c = to_ctrl(w);
+    if (!c) {
+      return nullptr;
+    }
+    c->increment_use_count();
+    return access::adopt(c);
+  }
+
+  // Like load(), but leaves the count alone.
+  snapshot protect(hazard_pointer &hp) const {
+    ::std::uintptr_t w = hp.protect(word_, to_ctrl);
+    snapshot s;
+    s.ctrl_ = to_ctrl(w);
+    s.ptr_ = s.ctrl_ ? static_cast<element_type *>(s.ctrl_->getaddr()) : nullptr;
+    s.marked_ = w & mark_bit;
+    return s;
+  }
+
+  bool is_marked() const {
+    return word_.load(::std::memory_order_acquire) & mark_bit;
+  }
+
+  void store(shared_ptr<T> desired, bool mark = false) {
+    auto w = to_word(access::release(desired), mark);
+    access::retire(to_ctrl(word_.exchange(w)));
+  }
+
+  // Replaces (expected, expected_mark) with (desired, desired_mark). Unlike
+  // atomic_shared_ptr, `expected` is left alone on failure.
+  bool compare_exchange(const shared_ptr<T> &expected, bool expected_mark,
+                        shared_ptr<T> desired, bool desired_mark) {
+    if (!access::canonical(expected)) {
+      return false;
+    }
+    auto exp = to_word(access::ctrl(expected), expected_mark);
+    detail::control_block *des = access::release(desired);
+    if (!word_.compare_exchange_strong(exp, to_word(des, desired_mark))) {
+      desired = access::adopt(des);
+      return false;
+    }
+    access::retire(to_ctrl(exp));
+    return true;
+  }
+
+  // Sets the mark if the unmarked value is still `expected`.
+  bool try_mark(const shared_ptr<T> &expected) {
+    if (!access::canonical(expected)) {
+      return false;
+    }
+    auto exp = to_word(access::ctrl(expected), false);
+    return word_.compare_exchange_strong(exp, exp | mark_bit);
+  }
+
+  // See atomic_shared_ptr::unsafe_take().
+  shared_ptr<T> unsafe_take() noexcept {
+    return access::adopt(
+        to_ctrl(word_.exchange(0, ::std::memory_order_relaxed)));
+  }
+
+private:
+  static constexpr ::std::uintptr_t mark_bit = 1;
+
+  ::std::atomic<::std::uintptr_t> word_{0};
+
+  static detail::control_block *to_ctrl(::std::uintptr_t w) {
+    return reinterpret_cast<detail::control_block *>(w & ~mark_bit);
+  }
+
+  static ::std::uintptr_t to_word(detail::control_block *c, bool mark) {
+    return reinterpret_cast<::std::uintptr_t>(c) | (mark ? mark_bit : 0);
+  }
+};
+
+} // namespace lockfree
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "shared_ptr.hpp"
+
+namespace lockfree {
+
+// Runs deleters on a background thread, so that dropping the last reference to
+// a large object graph doesn't stall whatever thread happened to drop it.
+// Producers push onto a lock-free stack; the reclaimer takes the whole stack
+// at once and runs it oldest first.
+class background_reclaimer {
+public:
+  static background_reclaimer &global() {
+    static background_reclaimer instance;
+    return instance;
+  }
+
+  background_reclaimer(const background_reclaimer &) = delete;
+  background_reclaimer &operator=(const background_reclaimer &) = delete;
+
+  // Calls `deleter(ptr)` on the reclaimer thread. After shutdown it runs
+  // right away instead.
+  template <typename P, typename Deleter> void defer(P *ptr, Deleter deleter) {
+    if (shut_down_.load(::std::memory_order_acquire)) {
+      deleter(ptr);
+      return;
+    }
+    push(new task_impl<P, Deleter>(ptr, ::std::move(deleter)));
+  }
+
+  // Waits until everything deferred so far has run, including whatever their
+  // deleters deferred in turn. Meant for shutdown and tests; with other
+  // threads deferring all the time it may not return.
+  void drain() {
+    assert(::std::this_thread::get_id() != thread_.get_id());
+    while (true) {
+      long target = deferred_.load(::std::memory_order_acquire);
+      long done = completed_.load(::std::memory_order_acquire);
+      while (done < target) {
+        completed_.wait(done, ::std::memory_order_acquire);
+        done = completed_.load(::std::memory_order_acquire);
+      }
+      if (deferred_.load(::std::memory_order_acquire) == target) {
+        return;
+      }
+    }
+  }
+
+  // Deleters deferred but not run yet.
+  long pending() const {
+    return deferred_.load(::std::memory_order_relaxed) -
+           completed_.load(::std::memory_order_relaxed);
+  }
+
+private:
+  struct task {
+    task *next = nullptr;
+    virtual void run() = 0;
+    virtual ~task() = default;
+  };
+
+  template <typename P, typename Deleter> struct task_impl : task {
+    task_impl(P *p, Deleter d) : ptr(p), deleter(::std::move(d)) {}
+
+    void run() override { deleter(ptr); }
+
+    P *ptr;
+    Deleter deleter;
+  };
+
+  // Sets `stop_` from the reclaimer thread itself, so the thread can't miss
+  // the wakeup.
+  struct stop_task : task {
+    explicit stop_task(background_reclaimer &r) : owner(r) {}
+
+    void run() override { owner.stop_ = true; }
+
+    background_reclaimer &owner;
+  };
+
+  ::std::atomic<task *> head_{nullptr};
+  ::std::atomic<long> deferred_{0};
+  ::std::atomic<long> completed_{0};
+  ::std::atomic<bool> shut_down_{false};
+  bool stop_ = false; // Only touched by the reclaimer thread.
+  ::std::thread thread_;
+
+  background_reclaimer() : thread_([this] { loop(); }) {}
+
+  ~background_reclaimer() {
+    push(new stop_task(*this));
+    thread_.join();
+    shut_down_.store(true, ::std::memory_order_release);
+    run_all(head_.exchange(nullptr, ::std::memory_order_acquire));
+  }
+
+  void push(task *t) {
+    deferred_.fetch_add(1, ::std::memory_order_relaxed);
+    task *head = head_.load(::std::memory_order_relaxed);
+    do {
+      t->next = head;
+    } while (!head_.compare_exchange_weak(head, t, ::std::memory_order_release,
+                                          ::std::memory_order_relaxed));
+    // The reclaimer only sleeps on an empty stack.
+    if (!head) {
+      head_.notify_one();
+    }
+  }
+
+  void loop() {
+    while (!stop_) {
+      task *batch = head_.exchange(nullptr, ::std::memory_order_acquire);
+      if (!batch) {
+        head_.wait(nullptr, ::std::memory_order_acquire);
+        continue;
+      }
+      run_all(batch);
+    }
+  }
+
+  // Runs a stack of tasks in the order they were pushed.
+  void run_all(task *batch) {
+    task *fifo = nullptr;
+    long n = 0;
+    while (batch) {
+      task *next = batch->next;
+      batch->next = fifo;
+      fifo = batch;
+      batch = next;
+      ++n;
+    }
+    while (fifo) {
+      task *next = fifo->next;
+      fifo->run();
+      delete fifo;
+      fifo = next;
+    }
+    if (n) {
+      completed_.fetch_add(n, ::std::memory_order_release);
+      completed_.notify_all();
+    }
+  }
+};
+
+// Hands the object to the background reclaimer instead of destroying it in
+// place; `Deleter` does the actual destruction over there.
+template <typename T, typename Deleter> struct background_deleter {
+  using element_type =
+      ::std::conditional_t<::std::is_array_v<T>, ::std::remove_extent_t<T>, T>;
+
+  Deleter deleter;
+
+  void operator()(element_type *ptr) const {
+    background_reclaimer::global().defer(ptr, deleter);
+  }
+};
+
+// Tag for make_shared: destroy this object in the background.
+struct background_destroy_t {};
+inline constexpr background_destroy_t background_destroy{};
+
+template <class T, class... Args>
+shared_ptr<T> make_shared(background_destroy_t, Args &&...args) {
+  return shared_ptr<T>(new T(::std::forward<Args>(args)...),
+                       background_deleter<T>{});
+}
+
+} // namespace lockfree
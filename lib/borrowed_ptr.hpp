@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+#include "shared_ptr.hpp"
+
+namespace lockfree {
+
+// A shared_ptr lent out for the length of a call. It's the same pointer pair,
+// but copying and dropping it doesn't touch the count, so it can be passed
+// down a call chain where shared_ptr by value would pay two RMWs per call.
+// A callee that keeps the object calls share().
+//
+// Whoever lent it must keep the object alive while it's borrowed. Built with
+// -DLOCKFREE_CHECK_BORROWS, which every translation unit of the program must
+// agree on, control blocks count borrows and the process aborts when an
+// object is destroyed while still borrowed.
+template <typename T, typename Policy> class basic_borrowed_ptr {
+public:
+  template <typename Y, typename P> friend class basic_borrowed_ptr;
+
+  using element_type = typename basic_shared_ptr<T, Policy>::element_type;
+
+  constexpr basic_borrowed_ptr() noexcept = default;
+
+  constexpr basic_borrowed_ptr(::std::nullptr_t) noexcept {}
+
+  template <typename Y>
+    requires(detail::convertible<element_type, Y>)
+  basic_borrowed_ptr(const basic_shared_ptr<Y, Policy> &owner) noexcept
+      : ptr_(owner.ptr_), ctrl_(owner.ctrl_) {
+    borrow();
+  }
+
+  template <typename Y>
+    requires(detail::convertible<element_type, Y>)
+  basic_borrowed_ptr(const basic_borrowed_ptr<Y, Policy> &r) noexcept
+      : ptr_(r.ptr_), ctrl_(r.ctrl_) {
+    borrow();
+  }
+
+#ifndef LOCKFREE_CHECK_BORROWS
+  basic_borrowed_ptr(const basic_borrowed_ptr &) noexcept = default;
+  basic_borrowed_ptr &operator=(const basic_borrowed_ptr &) noexcept = default;
+  ~basic_borrowed_ptr() = default;
+#else
+  basic_borrowed_ptr(const basic_borrowed_ptr &r) noexcept
+      : ptr_(r.ptr_), ctrl_(r.ctrl_) {
+    borrow();
+  }
+
+  basic_borrowed_ptr &operator=(const basic_borrowed_ptr &r) noexcept {
+    basic_borrowed_ptr temp(r);
+    ::std::swap(ptr_, temp.ptr_);
+    ::std::swap(ctrl_, temp.ctrl_);
+    return *this;
+  }
+
+  ~basic_borrowed_ptr() {
+    if (ctrl_) {
+      Policy::counter::decrement(ctrl_->borrow_count);
+    }
+  }
+#endif
+
+  // An owning pointer to the same object, for callees that keep it.
+  basic_shared_ptr<T, Policy> share() const noexcept {
+    if (!ctrl_) {
+      return nullptr;
+    }
+    ctrl_->increment_use_count();
+    return basic_shared_ptr<T, Policy>(detail::adopt_t{}, ptr_, ctrl_);
+  }
+
+  element_type *get() const noexcept { return ptr_; }
+
+  element_type &operator*() const noexcept { return *ptr_; }
+
+  element_type *operator->() const noexcept { return ptr_; }
+
+  long use_count() const noexcept {
+    return ctrl_ ? ctrl_->load_use_count() : 0;
+  }
+
+  explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+private:
+  element_type *ptr_ = nullptr;
+  detail::basic_control_block<typename Policy::counter> *ctrl_ = nullptr;
+
+  void borrow() noexcept {
+#ifdef LOCKFREE_CHECK_BORROWS
+    if (ctrl_) {
+      Policy::counter::increment(ctrl_->borrow_count);
+    }
+#endif
+  }
+};
+
+template <typename T> using borrowed_ptr = basic_borrowed_ptr<T>;
+
+} // namespace lockfree
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace lockfree {
+
+// Hash map from K to shared_ptr<V>. Every bucket is an immutable vector behind
+// an atomic_shared_ptr; writers copy the bucket and CAS it in, readers never
+// write anything shared except their own hazard slots.
+//
+// Growing is incremental. The new table starts with empty slots and keeps the
+// old one around. A slot is filled by freezing the matching old bucket and
+// splitting it; readers fall back to the old table for slots that aren't
+// filled yet, and every write migrates a couple of slots.
+template <typename K, typename V, typename Hash = ::std::hash<K>,
+          typename KeyEqual = ::std::equal_to<K>>
+class concurrent_map {
+  struct entry {
+    ::std::size_t hash;
+    K key;
+    shared_ptr<V> value;
+  };
+
+  struct bucket {
+    ::std::vector<entry> entries;
+    bool frozen = false; // Migrated; writers must retry on the newer table.
+  };
+
+  struct table {
+    explicit table(::std::size_t n)
+        : mask(n - 1), buckets(new atomic_shared_ptr<bucket>[n]) {}
+
+    ::std::size_t size() const { return mask + 1; }
+
+    atomic_shared_ptr<bucket> &slot(::std::size_t hash) {
+      return buckets[hash & mask];
+    }
+
+    ::std::size_t mask;
+    ::std::unique_ptr<atomic_shared_ptr<bucket>[]> buckets;
+    atomic_shared_ptr<table> old;         // Non-null while migrating.
+    ::std::atomic<::std::size_t> cursor{0}; // Next slot to migrate.
+    ::std::atomic<::std::size_t> migrated{0};
+  };
+
+public:
+  static constexpr ::std::size_t initial_buckets = 16;
+  static constexpr ::std::size_t migrate_per_write = 2;
+
+  explicit concurrent_map(::std::size_t buckets = initial_buckets) {
+    ::std::size_t n = 1;
+    while (n < buckets) {
+      n <<= 1;
+    }
+    auto t = make_shared<table>(n);
+    auto empty = make_shared<bucket>();
+    for (::std::size_t i = 0; i < n; ++i) {
+      t->buckets[i].store(empty);
+    }
+    table_.store(::std::move(t));
+  }
+
+  concurrent_map(const concurrent_map &) = delete;
+  concurrent_map &operator=(const concurrent_map &) = delete;
+
+  // Lock-free; takes one reference on the value.
+  shared_ptr<V> find(const K &key) const {
+    guarded_ptr<const entry> e = find_entry(key);
+    return e ? e->value : nullptr;
+  }
+
+  // Lock-free and doesn't touch any reference count. The result holds up to
+  // three of the thread's eight hazard slots, as a lookup needs the table
+  // and the bucket, so a thread may hold two results at once, or one while
+  // it keeps calling the map. Going over aborts.
+  guarded_ptr<const V> find_guarded(const K &key) const {
+    guarded_ptr<const entry> e = find_entry(key);
+    if (!e) {
+      return {};
+    }
+    const V *value = e->value.get();
+    return guarded_ptr<const V>(::std::move(e), value);
+  }
+
+  bool contains(const K &key) const { return bool(find_entry(key)); }
+
+  // Inserts only if `key` is absent. Returns whether it did.
+  bool insert(const K &key, shared_ptr<V> value) {
+    return update(key, [&](::std::vector<entry> &entries, entry *e) {
+      if (e) {
+        return false;
+      }
+      entries.push_back({hash_(key), key, value});
+      return true;
+    });
+  }
+
+  // Returns true if `key` was inserted, false if its value was replaced.
+  bool insert_or_assign(const K &key, shared_ptr<V> value) {
+    bool inserted = false;
+    update(key, [&](::std::vector<entry> &entries, entry *e) {
+      inserted = !e;
+      if (e) {
+        e->value = value;
+      } else {
+        entries.push_back({hash_(key), key, value});
+      }
+      return true;
+    });
+    return inserted;
+  }
+
+  bool erase(const K &key) {
+    return update(key, [&](::std::vector<entry> &entries, entry *e) {
+      if (!e) {
+        return false;
+      }
+      *e = ::std::move(entries.back());
+      entries.pop_back();
+      return true;
+    });
+  }
+
+  // Approximate while writers are running.
+  ::std::size_t size() const {
+    return static_cast<::std::size_t>(
+        ::std::max<long>(0, size_.load(::std::memory_order_relaxed)));
+  }
+
+  ::std::size_t bucket_count() const { return table_.load()->size(); }
+
+private:
+  mutable atomic_shared_ptr<table> table_;
+  ::std::atomic<long> size_{0};
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] KeyEqual equal_;
+
+  const entry *lookup(const bucket *b, ::std::size_t h, const K &key) const {
+    for (auto &e : b->entries) {
+      if (e.hash == h && equal_(e.key, key)) {
+        return &e;
+      }
+    }
+    return nullptr;
+  }
+
+  guarded_ptr<const entry> find_entry(const K &key) const {
+    ::std::size_t h = hash_(key);
+    guarded_ptr<const entry> g;
+    table *t = table_.protect(g.add_guard());
+    hazard_pointer &bucket_hp = g.add_guard();
+    bucket *b = t->slot(h).protect(bucket_hp);
+    if (!b) {
+      // Not migrated yet; the old table still has the authoritative bucket.
+      // If the migration finished in between, the slot is filled by now.
+      table *o = t->old.protect(g.add_guard());
+      b = (o ? o->slot(h) : t->slot(h)).protect(bucket_hp);
+    }
+    g.reset(lookup(b, h, key));
+    return g;
+  }
+
+  // Copies the bucket holding `key`, lets `fn(entries, entry_or_null)` edit
+  // the copy and publishes it. `fn` returns false to leave the map unchanged.
+  template <typename F> bool update(const K &key, F fn) {
+    ::std::size_t h = hash_(key);
+    while (true) {
+      shared_ptr<table> t = table_.load();
+      auto &slot = t->slot(h);
+      shared_ptr<bucket> b = slot.load();
+      if (!b) {
+        migrate(*t, h & t->mask);
+        continue;
+      }
+      if (b->frozen) {
+        continue; // A resize replaced `t`; retry on the new table.
+      }
+      auto copy = make_shared<bucket>();
+      copy->entries = b->entries;
+      entry *e = nullptr;
+      for (auto &x : copy->entries) {
+        if (x.hash == h && equal_(x.key, key)) {
+          e = &x;
+          break;
+        }
+      }
+      ::std::size_t before = copy->entries.size();
+      if (!fn(copy->entries, e)) {
+        return false;
+      }
+      long delta = long(copy->entries.size()) - long(before);
+      if (!slot.compare_exchange_strong(b, ::std::move(copy))) {
+        continue;
+      }
+      if (delta) {
+        size_.fetch_add(delta, ::std::memory_order_relaxed);
+      }
+      help_migrate(*t);
+      if (delta > 0) {
+        maybe_grow(::std::move(t));
+      }
+      return true;
+    }
+  }
+
+  void maybe_grow(shared_ptr<table> t) {
+    if (size_.load(::std::memory_order_relaxed) <= long(t->size()) ||
+        t->old.load()) {
+      return;
+    }
+    auto bigger = make_shared<table>(t->size() * 2);
+    bigger->old.store(t);
+    table_.compare_exchange_strong(t, ::std::move(bigger));
+  }
+
+  void help_migrate(table &t) {
+    for (::std::size_t i = 0; i < migrate_per_write; ++i) {
+      if (!t.old.load()) {
+        return;
+      }
+      ::std::size_t next = t.cursor.fetch_add(1, ::std::memory_order_relaxed);
+      if (next >= t.size()) {
+        return;
+      }
+      migrate(t, next);
+    }
+  }
+
+  // Fills slot `i` of `t` from its old table.
+  void migrate(table &t, ::std::size_t i) {
+    shared_ptr<table> old = t.old.load();
+    if (!old || t.buckets[i].load()) {
+      return;
+    }
+    auto &src = old->buckets[i & old->mask];
+    shared_ptr<bucket> b = src.load();
+    while (!b->frozen) {
+      auto frozen = make_shared<bucket>();
+      frozen->entries = b->entries;
+      frozen->frozen = true;
+      if (src.compare_exchange_strong(b, frozen)) {
+        b = ::std::move(frozen);
+      }
+    }
+    auto split = make_shared<bucket>();
+    for (auto &e : b->entries) {
+      if ((e.hash & t.mask) == i) {
+        split->entries.push_back(e);
+      }
+    }
+    shared_ptr<bucket> expected = nullptr;
+    if (t.buckets[i].compare_exchange_strong(expected, ::std::move(split)) &&
+        t.migrated.fetch_add(1, ::std::memory_order_acq_rel) + 1 == t.size()) {
+      t.old.store(nullptr);
+    }
+  }
+};
+
+} // namespace lockfree
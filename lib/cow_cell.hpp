@@ -0,0 +1,68 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace lockfree {
+
+// Copy-on-write publication cell for read-mostly data such as configuration.
+// Readers take immutable snapshots; a writer copies the current version,
+// edits the copy and publishes it with a CAS. A version is destroyed once the
+// cell and every snapshot of it are gone.
+template <typename T> class cow_cell {
+public:
+  // Constructs the first version from `args`. Never a copy of another cell.
+  template <typename... Args>
+    requires(::std::is_constructible_v<T, Args...> &&
+             !(sizeof...(Args) == 1 &&
+               (::std::is_same_v<::std::remove_cvref_t<Args>, cow_cell> &&
+                ...)))
+  explicit cow_cell(Args &&...args)
+      : value_(make_shared<const T>(::std::forward<Args>(args)...)) {}
+
+  cow_cell(const cow_cell &) = delete;
+  cow_cell &operator=(const cow_cell &) = delete;
+
+  // A snapshot that stays valid however many updates follow.
+  shared_ptr<const T> read() const { return value_.load(); }
+
+  // Same, but without touching the reference count. Keep it short-lived; it
+  // holds one of the thread's hazard slots.
+  guarded_ptr<const T> read_guarded() const {
+    guarded_ptr<const T> g;
+    g.reset(value_.protect(g.add_guard()));
+    return g;
+  }
+
+  void store(T value) {
+    value_.store(make_shared<const T>(::std::move(value)));
+    collect();
+  }
+
+  // Applies `fn(T &)` to a copy of the current version and publishes it,
+  // retrying on a fresh copy if another writer got there first. `fn` may run
+  // more than once. Returns the published version.
+  template <typename F> shared_ptr<const T> update(F fn) {
+    shared_ptr<const T> current = value_.load();
+    while (true) {
+      auto next = make_shared<T>(*current);
+      fn(*next);
+      shared_ptr<const T> published = ::std::move(next);
+      if (value_.compare_exchange_weak(current, published)) {
+        collect();
+        return published;
+      }
+    }
+  }
+
+private:
+  atomic_shared_ptr<const T> value_;
+
+  // Writes are rare, so scan right away instead of letting replaced versions
+  // wait in the retire list. Without readers the old version dies here.
+  static void collect() { hazard_pointer_domain::global().scan(); }
+};
+
+} // namespace lockfree
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+
+// Epoch-based reclamation (Fraser, "Practical lock-freedom", section 5.2.3).
+// Readers pin the current epoch for the length of a guard; what's retired in
+// epoch e is freed once the global epoch reached e + 2, which it can only do
+// after every thread pinned in e has let go. Reads cost one fence per guard
+// instead of one per pointer, but a single stalled reader stops reclamation
+// for everybody.
+
+namespace lockfree {
+
+class ebr_domain {
+  struct record;
+
+public:
+  using reclaim_fn = void (*)(void *);
+
+  // Retired objects are handed over in batches of this size.
+  static constexpr ::std::size_t batch_size = 64;
+
+  class guard;
+  class thread_handle;
+
+  ebr_domain() = default;
+
+  ebr_domain(const ebr_domain &) = delete;
+  ebr_domain &operator=(const ebr_domain &) = delete;
+
+  // Every thread_handle must be gone by now. Frees whatever is still retired.
+  ~ebr_domain() {
+    for (auto &b : orphans_) {
+      free_bag(b);
+    }
+    record *r = records_.load(::std::memory_order_acquire);
+    while (r) {
+      assert(!r->in_use.load(::std::memory_order_relaxed));
+      record *next = r->next;
+      delete r;
+      r = next;
+    }
+  }
+
+  static ebr_domain &global() {
+    static ebr_domain domain;
+    return domain;
+  }
+
+  // The calling thread's membership in the domain. Guards and retirement go
+  // through it, and it must stay on the thread.
+  thread_handle register_thread();
+
+  ::std::uint64_t epoch() const {
+    return epoch_.load(::std::memory_order_acquire);
+  }
+
+  // Objects retired but not freed yet. Leaves out each thread's unfinished
+  // batch.
+  long limbo_size() const { return limbo_.load(::std::memory_order_relaxed); }
+
+private:
+  struct retired {
+    void *ptr;
+    reclaim_fn reclaim;
+  };
+
+  struct bag {
+    ::std::uint64_t epoch; // Safe to free once the domain reaches epoch + 2.
+    ::std::vector<retired> items;
+  };
+
+  struct alignas(64) record {
+    // (epoch << 1) | 1 while pinned, 0 otherwise.
+    ::std::atomic<::std::uint64_t> state{0};
+    ::std::atomic<bool> in_use{false};
+    record *next = nullptr;
+    // Only touched by the owner.
+    unsigned nesting = 0;
+    ::std::vector<retired> current;
+    ::std::deque<bag> limbo;
+  };
+
+  ::std::atomic<::std::uint64_t> epoch_{0};
+  ::std::atomic<record *> records_{nullptr};
+  ::std::atomic<long> limbo_{0};
+  ::std::mutex orphans_mutex_;
+  ::std::deque<bag> orphans_; // Left behind by exited threads.
+
+  record *acquire_record() {
+    for (record *r = records_.load(::std::memory_order_acquire); r;
+         r = r->next) {
+      bool expected = false;
+      if (!r->in_use.load(::std::memory_order_relaxed) &&
+          r->in_use.compare_exchange_strong(expected, true,
+                                            ::std::memory_order_acquire)) {
+        return r;
+      }
+    }
+    record *r = new record;
+    r->in_use.store(true, ::std::memory_order_relaxed);
+    record *head = records_.load(::std::memory_order_relaxed);
+    do {
+      r->next = head;
+    } while (!records_.compare_exchange_weak(head, r,
+                                             ::std::memory_order_release,
+                                             ::std::memory_order_relaxed));
+    return r;
+  }
+
+  void release_record(record *r) {
+    assert(r->nesting == 0);
+    seal(r);
+    {
+      ::std::lock_guard lk(orphans_mutex_);
+      for (auto &b : r->limbo) {
+        orphans_.push_back(::std::move(b));
+      }
+    }
+    r->limbo.clear();
+    r->in_use.store(false, ::std::memory_order_release);
+  }
+
+  void pin(record *r) {
+    if (r->nesting++ == 0) {
+      ::std::uint64_t e = epoch_.load(::std::memory_order_relaxed);
+      r->state.store(e << 1 | 1, ::std::memory_order_relaxed);
+      // Publish the pin before reading anything it protects.
+      ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    }
+  }
+
+  void unpin(record *r) {
+    assert(r->nesting > 0);
+    if (--r->nesting == 0) {
+      r->state.store(0, ::std::memory_order_release);
+    }
+  }
+
+  void retire(record *r, void *ptr, reclaim_fn reclaim) {
+    r->current.push_back({ptr, reclaim});
+    if (r->current.size() >= batch_size) {
+      collect(r);
+    }
+  }
+
+  // Closes the current batch under the current epoch. Everything in it was
+  // retired in that epoch or earlier.
+  void seal(record *r) {
+    if (r->current.empty()) {
+      return;
+    }
+    limbo_.fetch_add(long(r->current.size()), ::std::memory_order_relaxed);
+    r->limbo.push_back({epoch_.load(::std::memory_order_acquire),
+                        ::std::move(r->current)});
+    r->current = {};
+    r->current.reserve(batch_size);
+  }
+
+  // The epoch moves on once every pinned thread has seen it.
+  bool try_advance() {
+    ::std::uint64_t e = epoch_.load(::std::memory_order_acquire);
+    ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    for (record *r = records_.load(::std::memory_order_acquire); r;
+         r = r->next) {
+      ::std::uint64_t s = r->state.load(::std::memory_order_acquire);
+      if ((s & 1) && (s >> 1) != e) {
+        return false;
+      }
+    }
+    return epoch_.compare_exchange_strong(e, e + 1, ::std::memory_order_acq_rel);
+  }
+
+  bool expired(const bag &b) const {
+    return b.epoch + 2 <= epoch_.load(::std::memory_order_acquire);
+  }
+
+  void free_bag(bag &b) {
+    for (auto &x : b.items) {
+      x.reclaim(x.ptr);
+    }
+    limbo_.fetch_sub(long(b.items.size()), ::std::memory_order_relaxed);
+    b.items.clear();
+  }
+
+  void collect(record *r) {
+    seal(r);
+    try_advance();
+    // A reclaim function may retire more, so don't hold on to references
+    // into the deque while it runs.
+    while (!r->limbo.empty() && expired(r->limbo.front())) {
+      bag b = ::std::move(r->limbo.front());
+      r->limbo.pop_front();
+      free_bag(b);
+    }
+    collect_orphans();
+  }
+
+  void collect_orphans() {
+    ::std::deque<bag> ready;
+    {
+      ::std::unique_lock lk(orphans_mutex_, ::std::try_to_lock);
+      if (!lk) {
+        return;
+      }
+      while (!orphans_.empty() && expired(orphans_.front())) {
+        ready.push_back(::std::move(orphans_.front()));
+        orphans_.pop_front();
+      }
+    }
+    for (auto &b : ready) {
+      free_bag(b);
+    }
+  }
+};
+
+// Pins the epoch while alive. Guards nest.
+class ebr_domain::guard {
+public:
+  guard(const guard &) = delete;
+  guard &operator=(const guard &) = delete;
+
+  ~guard() { domain_->unpin(rec_); }
+
+private:
+  friend class thread_handle;
+
+  guard(ebr_domain *domain, record *rec) : domain_(domain), rec_(rec) {
+    domain_->pin(rec_);
+  }
+
+  ebr_domain *domain_;
+  record *rec_;
+};
+
+class ebr_domain::thread_handle {
+public:
+  thread_handle() = default;
+
+  thread_handle(thread_handle &&other) noexcept
+      : domain_(::std::exchange(other.domain_, nullptr)),
+        rec_(::std::exchange(other.rec_, nullptr)) {}
+
+  thread_handle &operator=(thread_handle &&other) noexcept {
+    thread_handle tmp(::std::move(other));
+    ::std::swap(domain_, tmp.domain_);
+    ::std::swap(rec_, tmp.rec_);
+    return *this;
+  }
+
+  // What this thread still has in limbo is freed by whoever collects after
+  // it becomes safe.
+  ~thread_handle() {
+    if (rec_) {
+      domain_->release_record(rec_);
+    }
+  }
+
+  guard pin() { return guard(domain_, rec_); }
+
+  // `reclaim(ptr)` runs once no guard that was active at this point is left.
+  void retire(void *ptr, reclaim_fn reclaim) {
+    domain_->retire(rec_, ptr, reclaim);
+  }
+
+  // A stateless deleter costs nothing extra; any other is kept in a small
+  // allocation until it runs.
+  template <typename T, typename Deleter = ::std::default_delete<T>>
+  void retire(T *ptr, Deleter deleter = {}) {
+    if constexpr (::std::is_empty_v<Deleter> &&
+                  ::std::is_default_constructible_v<Deleter>) {
+      reclaim_fn reclaim = [](void *p) { Deleter{}(static_cast<T *>(p)); };
+      retire(const_cast<void *>(static_cast<const void *>(ptr)), reclaim);
+    } else {
+      struct holder {
+        T *ptr;
+        Deleter deleter;
+      };
+      reclaim_fn reclaim = [](void *p) {
+        auto h = static_cast<holder *>(p);
+        h->deleter(h->ptr);
+        delete h;
+      };
+      retire(static_cast<void *>(new holder{ptr, ::std::move(deleter)}),
+             reclaim);
+    }
+  }
+
+  // Drops the reference once no guard that was active at this point is left,
+  // so readers under a guard may keep using the raw pointer.
+  template <typename T> void retire(shared_ptr<T> p) {
+    if (auto c = detail::shared_ptr_access<T>::release(p)) {
+      reclaim_fn reclaim = [](void *c) {
+        static_cast<detail::control_block *>(c)->decrement_use_count();
+      };
+      retire(static_cast<void *>(c), reclaim);
+    }
+  }
+
+  // Hands the unfinished batch over, tries to advance the epoch and frees
+  // what has become safe. Retiring does this every batch_size objects.
+  void collect() { domain_->collect(rec_); }
+
+private:
+  friend class ebr_domain;
+
+  thread_handle(ebr_domain *domain, record *rec) : domain_(domain), rec_(rec) {}
+
+  ebr_domain *domain_ = nullptr;
+  record *rec_ = nullptr;
+};
+
+inline ebr_domain::thread_handle ebr_domain::register_thread() {
+  return thread_handle(this, acquire_record());
+}
+
+} // namespace lockfree
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "asymmetric_fence.hpp"
+
+// A small hazard pointer domain (Maged Michael, "Hazard Pointers: Safe Memory
+// Reclamation for Lock-Free Objects"). atomic_shared_ptr uses it to keep the
+// reference owned by the atomic alive while a reader is between loading the
+// control block pointer and incrementing its count. Publishing a hazard uses
+// the light side of an asymmetric fence and scans the heavy one, so on Linux
+// readers don't execute a fence at all.
+
+namespace lockfree {
+
+class hazard_pointer;
+
+class hazard_pointer_domain {
+public:
+  using reclaim_fn = void (*)(void *);
+
+  // Live hazard_pointers per thread. Taking one more aborts the process.
+  static constexpr ::std::size_t slots_per_thread = 8;
+
+  // There's a single process-wide domain. Per-thread records are never freed,
+  // only recycled when their thread exits.
+  static hazard_pointer_domain &global() {
+    static hazard_pointer_domain domain;
+    return domain;
+  }
+
+  hazard_pointer_domain(const hazard_pointer_domain &) = delete;
+  hazard_pointer_domain &operator=(const hazard_pointer_domain &) = delete;
+
+  ~hazard_pointer_domain() {
+    // No other thread is running by now. Anything retired while we drain the
+    // lists is reclaimed right away.
+    shutting_down_.store(true, ::std::memory_order_relaxed);
+    record *r = records_.load(::std::memory_order_acquire);
+    while (r) {
+      ::std::vector<retired> pending;
+      pending.swap(r->retired_list);
+      for (auto &x : pending) {
+        x.reclaim(x.ptr);
+      }
+      record *next = r->next;
+      delete r;
+      r = next;
+    }
+  }
+
+  // `reclaim(ptr)` runs once no hazard pointer protects `ptr`. It may run on
+  // any thread that calls retire() later.
+  void retire(void *ptr, reclaim_fn reclaim) {
+    if (shutting_down_.load(::std::memory_order_relaxed)) {
+      reclaim(ptr);
+      return;
+    }
+    record *self = local();
+    self->retired_list.push_back({ptr, reclaim});
+    if (self->retired_list.size() >= threshold()) {
+      scan(self);
+    }
+  }
+
+  // Reclaims what the calling thread has retired and nobody protects.
+  void scan() { scan(local()); }
+
+private:
+  friend class hazard_pointer;
+
+  struct retired {
+    void *ptr;
+    reclaim_fn reclaim;
+  };
+
+  struct alignas(64) record {
+    ::std::atomic<void *> hazards[slots_per_thread] = {};
+    ::std::atomic<bool> active{false};
+    record *next = nullptr;
+    unsigned used = 0;     // Slots handed out; only touched by the owner.
+    bool scanning = false; // Set while the owner reclaims.
+    ::std::vector<retired> retired_list;
+  };
+
+  ::std::atomic<record *> records_{nullptr};
+  ::std::atomic<::std::size_t> record_count_{0};
+  ::std::atomic<bool> shutting_down_{false};
+
+  hazard_pointer_domain() = default;
+
+  ::std::size_t threshold() const {
+    auto n = record_count_.load(::std::memory_order_relaxed);
+    return ::std::max<::std::size_t>(64, 2 * slots_per_thread * n);
+  }
+
+  record *acquire_record() {
+    for (record *r = records_.load(::std::memory_order_acquire); r;
+         r = r->next) {
+      bool expected = false;
+      if (!r->active.load(::std::memory_order_relaxed) &&
+          r->active.compare_exchange_strong(expected, true,
+                                            ::std::memory_order_acquire)) {
+        return r;
+      }
+    }
+    record *r = new record;
+    r->active.store(true, ::std::memory_order_relaxed);
+    record *head = records_.load(::std::memory_order_relaxed);
+    do {
+      r->next = head;
+    } while (!records_.compare_exchange_weak(head, r,
+                                             ::std::memory_order_release,
+                                             ::std::memory_order_relaxed));
+    record_count_.fetch_add(1, ::std::memory_order_relaxed);
+    return r;
+  }
+
+  // Leftover retired pointers stay on the record; whoever picks it up next
+  // (or the domain destructor) reclaims them.
+  void release_record(record *r) {
+    scan(r);
+    r->used = 0;
+    r->active.store(false, ::std::memory_order_release);
+  }
+
+  record *local() {
+    // If something retires from a thread_local destructor after this one ran,
+    // the thread gets a fresh record that is never handed back. That's a
+    // bounded leak of one record, not a correctness problem.
+    thread_local struct owner {
+      record *rec = nullptr;
+      ~owner() {
+        if (rec) {
+          global().release_record(::std::exchange(rec, nullptr));
+        }
+      }
+    } o;
+    if (!o.rec) {
+      o.rec = acquire_record();
+    }
+    return o.rec;
+  }
+
+  // Reclaiming can retire more, e.g. a dead node releasing its links. Those
+  // are picked up by another pass with fresh hazards rather than a nested
+  // scan, so freeing a long chain doesn't recurse.
+  void scan(record *self) {
+    if (self->scanning) {
+      return; // Called from a reclaim function; the outer scan carries on.
+    }
+    self->scanning = true;
+    ::std::vector<void *> hazards;
+    ::std::vector<retired> pending;
+    bool progress = true;
+    while (progress && !self->retired_list.empty()) {
+      collect_hazards(hazards);
+      pending.clear();
+      pending.swap(self->retired_list);
+      progress = false;
+      for (auto &x : pending) {
+        if (::std::binary_search(hazards.begin(), hazards.end(), x.ptr)) {
+          self->retired_list.push_back(x);
+        } else {
+          x.reclaim(x.ptr);
+          progress = true;
+        }
+      }
+    }
+    self->scanning = false;
+  }
+
+  void collect_hazards(::std::vector<void *> &hazards) {
+    hazards.clear();
+    // Pairs with the light fence in hazard_pointer::protect().
+    detail::asymmetric_fence::heavy();
+    for (record *r = records_.load(::std::memory_order_acquire); r;
+         r = r->next) {
+      for (auto &h : r->hazards) {
+        if (void *p = h.load(::std::memory_order_acquire)) {
+          hazards.push_back(p);
+        }
+      }
+    }
+    ::std::sort(hazards.begin(), hazards.end());
+  }
+};
+
+// Owns one hazard slot of the calling thread for its lifetime.
+class hazard_pointer {
+public:
+  hazard_pointer() : rec_(hazard_pointer_domain::global().local()) {
+    unsigned free = ~rec_->used &
+                    ((1u << hazard_pointer_domain::slots_per_thread) - 1);
+    if (!free) {
+      // Checked in every build: the next slot would be past the record.
+      ::std::fputs("lockfree: out of hazard pointer slots\n", stderr);
+      ::std::abort();
+    }
+    index_ = static_cast<unsigned>(__builtin_ctz(free));
+    rec_->used |= 1u << index_;
+  }
+
+  hazard_pointer(const hazard_pointer &) = delete;
+  hazard_pointer &operator=(const hazard_pointer &) = delete;
+
+  // Moving hands the slot over; whatever it protects stays protected.
+  hazard_pointer(hazard_pointer &&other) noexcept
+      : rec_(::std::exchange(other.rec_, nullptr)), index_(other.index_) {}
+
+  ~hazard_pointer() {
+    if (rec_) {
+      reset();
+      rec_->used &= ~(1u << index_);
+    }
+  }
+
+  // Returns the current value of `src`, published as hazardous. The pointee
+  // can't be reclaimed until reset() or destruction.
+  template <typename P> P *protect(const ::std::atomic<P *> &src) {
+    return protect(src, [](P *p) { return p; });
+  }
+
+  // Same for a word that encodes a pointer, such as a pointer with a mark
+  // bit. `to_ptr(word)` extracts the pointer to publish.
+  template <typename W, typename ToPtr>
+  W protect(const ::std::atomic<W> &src, ToPtr to_ptr) {
+    auto &slot = rec_->hazards[index_];
+    W w = src.load(::std::memory_order_relaxed);
+    while (true) {
+      slot.store(to_ptr(w), ::std::memory_order_relaxed);
+      detail::asymmetric_fence::light();
+      W v = src.load(::std::memory_order_acquire);
+      if (v == w) {
+        return w;
+      }
+      w = v;
+    }
+  }
+
+  void reset() {
+    rec_->hazards[index_].store(nullptr, ::std::memory_order_release);
+  }
+
+private:
+  hazard_pointer_domain::record *rec_;
+  unsigned index_;
+};
+
+// A read-only reference that keeps its target alive through hazard pointers
+// instead of a reference count. It must stay on the thread that created it,
+// and shouldn't be held for long since it delays reclamation. Each one holds
+// up to max_guards of the thread's slots_per_thread hazard slots.
+template <typename V> class guarded_ptr {
+public:
+  static constexpr ::std::size_t max_guards = 3;
+
+  guarded_ptr() = default;
+
+  // Keeps the protection of `other` but points at `ptr`, typically a member of
+  // what `other` protects.
+  template <typename U>
+  guarded_ptr(guarded_ptr<U> &&other, V *ptr) noexcept
+      : guards_(::std::move(other.guards_)), ptr_(ptr) {}
+
+  // A fresh hazard slot whose protection lives as long as this guard.
+  hazard_pointer &add_guard() {
+    assert(used_ < max_guards);
+    return guards_[used_++].emplace();
+  }
+
+  void reset(V *ptr) noexcept { ptr_ = ptr; }
+
+  V *get() const noexcept { return ptr_; }
+
+  V &operator*() const noexcept { return *ptr_; }
+
+  V *operator->() const noexcept { return ptr_; }
+
+  explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+private:
+  template <typename U> friend class guarded_ptr;
+
+  ::std::optional<hazard_pointer> guards_[max_guards];
+  ::std::size_t used_ = 0;
+  V *ptr_ = nullptr;
+};
+
+} // namespace lockfree
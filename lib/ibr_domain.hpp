@@ -0,0 +1,392 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+
+// Interval-based reclamation, the 2GEIBR variant from Wen et al., "Interval-
+// Based Memory Reclamation" (PPoPP 2018). Every object knows the era it was
+// born in and the era it was retired in. A guard reserves the interval of
+// eras it has read in, and an object can be freed once its lifetime doesn't
+// overlap any reservation. Unlike ebr_domain, a stalled reader only pins the
+// objects that were alive while it was reading, so memory stays bounded.
+
+namespace lockfree {
+
+class ibr_domain {
+  struct record;
+
+public:
+  using reclaim_fn = void (*)(void *);
+
+  // Every thread advances the era after this many retirements, and scans its
+  // retired list when it grew by this many.
+  static constexpr ::std::size_t era_frequency = 64;
+  static constexpr ::std::size_t batch_size = 64;
+
+  class guard;
+  class thread_handle;
+
+  // Base for objects retired into an ibr_domain: records the era they were
+  // born in. The era clock is shared by all domains.
+  class object {
+  public:
+    object() noexcept : birth_era_(clock().load(::std::memory_order_acquire)) {}
+
+    object(const object &) noexcept : object() {}
+    object &operator=(const object &) noexcept { return *this; }
+
+    ::std::uint64_t birth_era() const noexcept { return birth_era_; }
+
+  private:
+    ::std::uint64_t birth_era_;
+  };
+
+  ibr_domain() = default;
+
+  ibr_domain(const ibr_domain &) = delete;
+  ibr_domain &operator=(const ibr_domain &) = delete;
+
+  // Every thread_handle must be gone by now. Frees whatever is still retired.
+  ~ibr_domain() {
+    for (auto &x : orphans_) {
+      x.reclaim(x.ptr);
+    }
+    record *r = records_.load(::std::memory_order_acquire);
+    while (r) {
+      assert(!r->in_use.load(::std::memory_order_relaxed));
+      record *next = r->next;
+      delete r;
+      r = next;
+    }
+  }
+
+  static ibr_domain &global() {
+    static ibr_domain domain;
+    return domain;
+  }
+
+  // See ebr_domain::register_thread().
+  thread_handle register_thread();
+
+  static ::std::uint64_t era() {
+    return clock().load(::std::memory_order_acquire);
+  }
+
+  // Objects retired but not freed yet. Leaves out what each thread retired
+  // since its last scan.
+  long limbo_size() const { return limbo_.load(::std::memory_order_relaxed); }
+
+private:
+  static constexpr ::std::uint64_t none =
+      ::std::numeric_limits<::std::uint64_t>::max();
+
+  struct retired {
+    void *ptr;
+    reclaim_fn reclaim;
+    ::std::uint64_t birth_era;
+    ::std::uint64_t retire_era;
+  };
+
+  struct alignas(64) record {
+    // The reserved interval of eras; both `none` outside of guards.
+    ::std::atomic<::std::uint64_t> lower{none};
+    ::std::atomic<::std::uint64_t> upper{none};
+    ::std::atomic<bool> in_use{false};
+    record *next = nullptr;
+    // Only touched by the owner.
+    unsigned nesting = 0;
+    bool scanning = false; // Reclaim functions retiring don't scan again.
+    ::std::size_t retire_count = 0;
+    ::std::size_t published = 0; // Part of retired_list counted in limbo_.
+    ::std::vector<retired> retired_list;
+  };
+
+  ::std::atomic<record *> records_{nullptr};
+  ::std::atomic<long> limbo_{0};
+  ::std::mutex orphans_mutex_;
+  ::std::vector<retired> orphans_; // Left behind by exited threads.
+
+  static ::std::atomic<::std::uint64_t> &clock() {
+    static ::std::atomic<::std::uint64_t> era{0};
+    return era;
+  }
+
+  record *acquire_record() {
+    for (record *r = records_.load(::std::memory_order_acquire); r;
+         r = r->next) {
+      bool expected = false;
+      if (!r->in_use.load(::std::memory_order_relaxed) &&
+          r->in_use.compare_exchange_strong(expected, true,
+                                            ::std::memory_order_acquire)) {
+        return r;
+      }
+    }
+    record *r = new record;
+    r->in_use.store(true, ::std::memory_order_relaxed);
+    record *head = records_.load(::std::memory_order_relaxed);
+    do {
+      r->next = head;
+    } while (!records_.compare_exchange_weak(head, r,
+                                             ::std::memory_order_release,
+                                             ::std::memory_order_relaxed));
+    return r;
+  }
+
+  void release_record(record *r) {
+    assert(r->nesting == 0);
+    {
+      ::std::lock_guard lk(orphans_mutex_);
+      orphans_.insert(orphans_.end(), r->retired_list.begin(),
+                      r->retired_list.end());
+    }
+    limbo_.fetch_add(long(r->retired_list.size() - r->published),
+                     ::std::memory_order_relaxed);
+    r->retired_list.clear();
+    r->published = 0;
+    r->in_use.store(false, ::std::memory_order_release);
+  }
+
+  void pin(record *r) {
+    if (r->nesting++ == 0) {
+      ::std::uint64_t e = era();
+      r->lower.store(e, ::std::memory_order_relaxed);
+      r->upper.store(e, ::std::memory_order_relaxed);
+      ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    }
+  }
+
+  void unpin(record *r) {
+    assert(r->nesting > 0);
+    if (--r->nesting == 0) {
+      r->upper.store(none, ::std::memory_order_release);
+      r->lower.store(none, ::std::memory_order_release);
+    }
+  }
+
+  // Extends the reservation up to the era the pointer is read in.
+  template <typename T>
+  T *protect(record *r, const ::std::atomic<T *> &src) {
+    assert(r->nesting > 0);
+    ::std::uint64_t reserved = r->upper.load(::std::memory_order_relaxed);
+    while (true) {
+      T *p = src.load(::std::memory_order_acquire);
+      ::std::uint64_t e = era();
+      if (e == reserved) {
+        return p;
+      }
+      r->upper.store(e, ::std::memory_order_relaxed);
+      ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+      reserved = e;
+    }
+  }
+
+  void retire(record *r, void *ptr, ::std::uint64_t birth_era,
+              reclaim_fn reclaim) {
+    r->retired_list.push_back({ptr, reclaim, birth_era, era()});
+    if (++r->retire_count % era_frequency == 0) {
+      clock().fetch_add(1, ::std::memory_order_acq_rel);
+    }
+    if (!r->scanning && r->retired_list.size() - r->published >= batch_size) {
+      scan(r);
+    }
+  }
+
+  struct interval {
+    ::std::uint64_t lower;
+    ::std::uint64_t upper;
+  };
+
+  void collect_reservations(::std::vector<interval> &out) {
+    out.clear();
+    ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    for (record *r = records_.load(::std::memory_order_acquire); r;
+         r = r->next) {
+      ::std::uint64_t lo = r->lower.load(::std::memory_order_acquire);
+      ::std::uint64_t hi = r->upper.load(::std::memory_order_acquire);
+      if (lo != none) {
+        out.push_back({lo, hi});
+      }
+    }
+  }
+
+  static bool conflicts(const retired &x, const ::std::vector<interval> &res) {
+    for (auto &i : res) {
+      if (x.birth_era <= i.upper && x.retire_era >= i.lower) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Frees everything in `list` whose lifetime misses every reservation and
+  // returns how many it freed. A reclaim function may retire more, so the
+  // survivors are kept in `list` before any of them run.
+  static long free_unreserved(::std::vector<retired> &list,
+                              const ::std::vector<interval> &res) {
+    ::std::vector<retired> ready;
+    auto keep = list.begin();
+    for (auto &x : list) {
+      if (conflicts(x, res)) {
+        *keep++ = x;
+      } else {
+        ready.push_back(x);
+      }
+    }
+    list.erase(keep, list.end());
+    for (auto &x : ready) {
+      x.reclaim(x.ptr);
+    }
+    return long(ready.size());
+  }
+
+  void scan(record *r) {
+    if (r->scanning) {
+      return;
+    }
+    r->scanning = true;
+    ::std::vector<interval> res;
+    collect_reservations(res);
+    long before = long(r->retired_list.size());
+    long freed = free_unreserved(r->retired_list, res);
+    // Whatever the reclaim functions retired meanwhile was appended after the
+    // survivors and isn't counted yet.
+    limbo_.fetch_add(before - long(r->published) - freed,
+                     ::std::memory_order_relaxed);
+    r->published = ::std::size_t(before - freed);
+
+    ::std::unique_lock lk(orphans_mutex_, ::std::try_to_lock);
+    if (lk && !orphans_.empty()) {
+      ::std::vector<retired> orphans;
+      orphans.swap(orphans_);
+      lk.unlock();
+      long n = free_unreserved(orphans, res);
+      limbo_.fetch_sub(n, ::std::memory_order_relaxed);
+      lk.lock();
+      orphans_.insert(orphans_.end(), orphans.begin(), orphans.end());
+    }
+    r->scanning = false;
+  }
+};
+
+// Reserves the current era while alive; pointers read through
+// thread_handle::protect() extend the reservation. Guards nest.
+class ibr_domain::guard {
+public:
+  guard(const guard &) = delete;
+  guard &operator=(const guard &) = delete;
+
+  ~guard() { domain_->unpin(rec_); }
+
+private:
+  friend class thread_handle;
+
+  guard(ibr_domain *domain, record *rec) : domain_(domain), rec_(rec) {
+    domain_->pin(rec_);
+  }
+
+  ibr_domain *domain_;
+  record *rec_;
+};
+
+class ibr_domain::thread_handle {
+public:
+  thread_handle() = default;
+
+  thread_handle(thread_handle &&other) noexcept
+      : domain_(::std::exchange(other.domain_, nullptr)),
+        rec_(::std::exchange(other.rec_, nullptr)) {}
+
+  thread_handle &operator=(thread_handle &&other) noexcept {
+    thread_handle tmp(::std::move(other));
+    ::std::swap(domain_, tmp.domain_);
+    ::std::swap(rec_, tmp.rec_);
+    return *this;
+  }
+
+  // Whatever is still retired is freed by whoever scans after it's safe.
+  ~thread_handle() {
+    if (rec_) {
+      domain_->release_record(rec_);
+    }
+  }
+
+  guard pin() { return guard(domain_, rec_); }
+
+  // Reads `src` inside a guard. Every shared pointer a reader follows must be
+  // read this way; a plain load isn't covered by the reservation.
+  template <typename T> T *protect(const ::std::atomic<T *> &src) {
+    return domain_->protect(rec_, src);
+  }
+
+  // `reclaim(ptr)` runs once no guard can still be reading an object that
+  // was born in `birth_era`.
+  void retire(void *ptr, ::std::uint64_t birth_era, reclaim_fn reclaim) {
+    domain_->retire(rec_, ptr, birth_era, reclaim);
+  }
+
+  template <typename T, typename Deleter = ::std::default_delete<T>>
+    requires ::std::is_base_of_v<object, T>
+  void retire(T *ptr, Deleter deleter = {}) {
+    ::std::uint64_t birth = ptr->birth_era();
+    if constexpr (::std::is_empty_v<Deleter> &&
+                  ::std::is_default_constructible_v<Deleter>) {
+      reclaim_fn reclaim = [](void *p) { Deleter{}(static_cast<T *>(p)); };
+      retire(const_cast<void *>(static_cast<const void *>(ptr)), birth,
+             reclaim);
+    } else {
+      struct holder {
+        T *ptr;
+        Deleter deleter;
+      };
+      reclaim_fn reclaim = [](void *p) {
+        auto h = static_cast<holder *>(p);
+        h->deleter(h->ptr);
+        delete h;
+      };
+      retire(static_cast<void *>(new holder{ptr, ::std::move(deleter)}),
+             birth, reclaim);
+    }
+  }
+
+  // Drops the reference once no guard can still be reading the object.
+  template <typename T>
+    requires ::std::is_base_of_v<object, T>
+  void retire(shared_ptr<T> p) {
+    if (!p) {
+      return;
+    }
+    ::std::uint64_t birth = p->birth_era();
+    reclaim_fn reclaim = [](void *c) {
+      static_cast<detail::control_block *>(c)->decrement_use_count();
+    };
+    retire(static_cast<void *>(detail::shared_ptr_access<T>::release(p)),
+           birth, reclaim);
+  }
+
+  // Frees what has become safe among this thread's retired objects. Retiring
+  // does this every batch_size objects.
+  void collect() { domain_->scan(rec_); }
+
+private:
+  friend class ibr_domain;
+
+  thread_handle(ibr_domain *domain, record *rec) : domain_(domain), rec_(rec) {}
+
+  ibr_domain *domain_ = nullptr;
+  record *rec_ = nullptr;
+};
+
+inline ibr_domain::thread_handle ibr_domain::register_thread() {
+  return thread_handle(this, acquire_record());
+}
+
+} // namespace lockfree
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "shared_ptr.hpp"
+
+namespace lockfree {
+
+namespace detail {
+// Pools that are still alive, so a thread exiting after its pool is gone
+// doesn't touch it. Leaked so that it outlives every thread_local.
+struct pool_registry {
+  ::std::mutex mutex;
+  ::std::unordered_set<::std::uint64_t> live;
+  ::std::atomic<::std::uint64_t> next_id{1};
+
+  static pool_registry &get() {
+    static pool_registry *r = new pool_registry;
+    return *r;
+  }
+};
+} // namespace detail
+
+// Recycles objects of one type together with their control blocks. The last
+// release of a make_pooled() pointer hands its slot back to the pool instead
+// of freeing it: to the releasing thread's cache, and from there in batches
+// of cache_size to a shared free list. Threads push batches onto the shared
+// list with a CAS and take all of it with one exchange, so there's no pop to
+// suffer ABA.
+//
+// By default the object is destroyed on release and constructed again from
+// make_pooled's arguments. With a `reset` function it stays alive instead:
+// release calls reset(object), and make_pooled hands it out again as it is,
+// ignoring the arguments unless it has to construct a new one.
+//
+// The pool must outlive every pointer it handed out. For a T destroyed in
+// the background, drain the reclaimer before destroying the pool.
+template <typename T> class object_pool {
+  static_assert(!::std::is_array_v<T>);
+
+  struct slot;
+  struct cache;
+
+public:
+  using reset_fn = void (*)(T &);
+
+  // Released slots a thread keeps for itself before it shares them.
+  static constexpr ::std::size_t cache_size = 64;
+
+  explicit object_pool(reset_fn reset = nullptr) : reset_(reset) {
+    auto &r = detail::pool_registry::get();
+    ::std::lock_guard lk(r.mutex);
+    r.live.insert(id_);
+  }
+
+  object_pool(const object_pool &) = delete;
+  object_pool &operator=(const object_pool &) = delete;
+
+  ~object_pool() {
+    {
+      auto &r = detail::pool_registry::get();
+      ::std::lock_guard lk(r.mutex);
+      r.live.erase(id_);
+    }
+    ::std::size_t freed =
+        free_chain(shared_.load(::std::memory_order_acquire));
+    for (cache *c : caches_) {
+      freed += free_chain(c->recycled) + free_chain(c->spare);
+      delete c;
+    }
+    assert(freed == allocated() && "pooled object outlived its pool");
+    (void)freed;
+  }
+
+  template <typename... Args> shared_ptr<T> make(Args &&...args) {
+    slot *s = acquire();
+    if (!s->constructed) {
+      try {
+        ::new (static_cast<void *>(s->object))
+            T(::std::forward<Args>(args)...);
+      } catch (...) {
+        recycle(s);
+        throw;
+      }
+      s->constructed = true;
+    }
+    auto b = ::new (static_cast<void *>(s->ctrl)) block(s);
+    return detail::adopt_block<T, default_policy>(b);
+  }
+
+  // Slots ever allocated, in use or not.
+  ::std::size_t allocated() const {
+    return allocated_.load(::std::memory_order_relaxed);
+  }
+
+private:
+  // The control block of a pooled object. Its final `delete`, whether from
+  // the last shared_ptr or the last weak_ptr, recycles the slot instead.
+  struct block final : detail::control_block_base<T> {
+    slot *slot_;
+
+    explicit block(slot *s) : slot_(s) { this->profile(typeid(T), sizeof(T)); }
+
+    void *getaddr() override {
+      return const_cast<void *>(static_cast<const void *>(getptr()));
+    }
+
+    T *getptr() {
+      return ::std::launder(reinterpret_cast<T *>(slot_->object));
+    }
+
+    void operator delete(block *b, ::std::destroying_delete_t) {
+      slot *s = b->slot_;
+      b->~block();
+      s->pool->recycle(s);
+    }
+
+  private:
+    void release() override {
+      detail::release_object<T>(this, [](block *b) {
+        b->slot_->pool->retire(b->slot_);
+        detail::release_block(b);
+      });
+    }
+  };
+
+  // A block and its object. They live side by side rather than one inside
+  // the other, so a reset object survives its block being rebuilt.
+  struct slot {
+    alignas(block) unsigned char ctrl[sizeof(block)];
+    alignas(T) unsigned char object[sizeof(T)];
+    object_pool *pool;
+    slot *next = nullptr;
+    bool constructed = false;
+  };
+
+  // A thread's slots. Only the thread using it touches the lists.
+  struct cache {
+    // Released by this thread; shared once there are cache_size of them.
+    slot *recycled = nullptr;
+    slot *recycled_tail = nullptr;
+    ::std::size_t recycled_size = 0;
+    // Taken from the shared list in one go.
+    slot *spare = nullptr;
+    bool in_use = true; // Guarded by caches_mutex_.
+  };
+
+  // The calling thread's caches, one per pool it used. Whatever is left in
+  // them goes back to the shared list when the thread exits.
+  static inline thread_local bool exited = false;
+
+  struct thread_caches {
+    struct entry {
+      ::std::uint64_t id;
+      object_pool *pool;
+      cache *c;
+    };
+    ::std::vector<entry> entries;
+
+    ~thread_caches() {
+      exited = true;
+      auto &r = detail::pool_registry::get();
+      ::std::lock_guard lk(r.mutex);
+      for (auto &e : entries) {
+        if (r.live.count(e.id)) {
+          e.pool->release_cache(*e.c);
+        }
+      }
+    }
+  };
+
+  const ::std::uint64_t id_ = detail::pool_registry::get().next_id++;
+  const reset_fn reset_;
+  ::std::atomic<slot *> shared_{nullptr};
+  ::std::atomic<::std::size_t> allocated_{0};
+  ::std::mutex caches_mutex_;
+  // One per thread using the pool; an exited thread's goes to the next.
+  ::std::vector<cache *> caches_;
+
+  // Null once the thread's caches are gone, for pointers that other
+  // thread_locals release as the thread exits.
+  cache *local() {
+    if (exited) {
+      return nullptr;
+    }
+    thread_local thread_caches caches;
+    for (auto &e : caches.entries) {
+      if (e.id == id_) {
+        return e.c;
+      }
+    }
+    // Forget pools destroyed since, so the list stays as short as the
+    // number of live pools this thread uses.
+    {
+      auto &r = detail::pool_registry::get();
+      ::std::lock_guard lk(r.mutex);
+      ::std::erase_if(caches.entries,
+                      [&](const auto &e) { return !r.live.count(e.id); });
+    }
+    cache *c = nullptr;
+    {
+      ::std::lock_guard lk(caches_mutex_);
+      for (cache *x : caches_) {
+        if (!x->in_use) {
+          c = x;
+          break;
+        }
+      }
+      if (c) {
+        c->in_use = true;
+      } else {
+        c = new cache;
+        caches_.push_back(c);
+      }
+    }
+    caches.entries.push_back({id_, this, c});
+    return c;
+  }
+
+  slot *acquire() {
+    if (cache *c = local()) {
+      if (slot *s = c->recycled) {
+        c->recycled = s->next;
+        --c->recycled_size;
+        return s;
+      }
+      if (!c->spare) {
+        c->spare = shared_.exchange(nullptr, ::std::memory_order_acquire);
+      }
+      if (slot *s = c->spare) {
+        c->spare = s->next;
+        return s;
+      }
+    }
+    allocated_.fetch_add(1, ::std::memory_order_relaxed);
+    auto s = new slot;
+    s->pool = this;
+    return s;
+  }
+
+  // The object's last reference is gone.
+  void retire(slot *s) {
+    if (reset_) {
+      reset_(*::std::launder(reinterpret_cast<T *>(s->object)));
+    } else {
+      ::std::launder(reinterpret_cast<T *>(s->object))->~T();
+      s->constructed = false;
+    }
+  }
+
+  // The block's last reference is gone too.
+  void recycle(slot *s) {
+    cache *c = local();
+    if (!c) {
+      share(s, s);
+      return;
+    }
+    if (!c->recycled) {
+      c->recycled_tail = s;
+    }
+    s->next = c->recycled;
+    c->recycled = s;
+    if (++c->recycled_size == cache_size) {
+      share(c->recycled, c->recycled_tail);
+      c->recycled = nullptr;
+      c->recycled_size = 0;
+    }
+  }
+
+  // Pushes the chain from `head` to `tail` onto the shared list.
+  void share(slot *head, slot *tail) {
+    slot *top = shared_.load(::std::memory_order_relaxed);
+    do {
+      tail->next = top;
+    } while (!shared_.compare_exchange_weak(top, head,
+                                            ::std::memory_order_release,
+                                            ::std::memory_order_relaxed));
+  }
+
+  // Shares everything in an exiting thread's cache and frees it up.
+  void release_cache(cache &c) {
+    if (c.recycled) {
+      share(c.recycled, c.recycled_tail);
+    }
+    if (slot *tail = c.spare) {
+      while (tail->next) {
+        tail = tail->next;
+      }
+      share(c.spare, tail);
+    }
+    ::std::lock_guard lk(caches_mutex_);
+    c = cache{};
+    c.in_use = false;
+  }
+
+  ::std::size_t free_chain(slot *s) {
+    ::std::size_t n = 0;
+    while (s) {
+      slot *next = s->next;
+      if (s->constructed) {
+        ::std::launder(reinterpret_cast<T *>(s->object))->~T();
+      }
+      delete s;
+      s = next;
+      ++n;
+    }
+    return n;
+  }
+};
+
+// A shared_ptr to an object from `pool`; see object_pool.
+template <class T, class... Args>
+shared_ptr<T> make_pooled(object_pool<T> &pool, Args &&...args) {
+  return pool.make(::std::forward<Args>(args)...);
+}
+
+} // namespace lockfree
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace lockfree {
+
+// Sorted map from K to shared_ptr<V> on a single linked list; Harris's
+// lock-free list with Michael's way of unlinking. A node is erased by marking
+// its link; whoever walks past a marked link unlinks the node. Meant for small
+// sorted sets that are read far more often than written.
+//
+// Links are atomic_markable_shared_ptr, so nothing leaks or dangles: lookups
+// and for_each() walk the list with hazard pointers, iterators hold their node
+// and are weakly consistent like skiplist_map's.
+template <typename K, typename V, typename Compare = ::std::less<K>>
+class ordered_list {
+  struct node;
+  using link = atomic_markable_shared_ptr<node>;
+  using snapshot = typename link::snapshot;
+
+  struct node {
+    K key;
+    atomic_shared_ptr<V> value;
+    link next;
+
+    node(const K &k, shared_ptr<V> v) : key(k), value(::std::move(v)) {}
+
+    // Readers step to the successor under a hazard pointer alone, so a dead
+    // node retires its link rather than dropping it.
+    ~node() { next.store(nullptr); }
+  };
+
+public:
+  class iterator {
+  public:
+    using value_type = ::std::pair<const K &, shared_ptr<V>>;
+
+    iterator() = default;
+
+    const K &key() const { return node_->key; }
+
+    shared_ptr<V> value() const { return node_->value.load(); }
+
+    value_type operator*() const { return {key(), value()}; }
+
+    // Moves to the next key that is present, skipping erased nodes.
+    iterator &operator++() {
+      node_ = next_present(node_->next.load());
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+      return node_.get() == other.node_.get();
+    }
+
+  private:
+    friend class ordered_list;
+
+    explicit iterator(shared_ptr<node> n) : node_(::std::move(n)) {}
+
+    shared_ptr<node> node_;
+  };
+
+  ordered_list() = default;
+
+  ordered_list(const ordered_list &) = delete;
+  ordered_list &operator=(const ordered_list &) = delete;
+
+  ~ordered_list() {
+    head_.store(nullptr);
+    hazard_pointer_domain::global().scan();
+  }
+
+  // Inserts only if `key` is absent. Returns whether it did.
+  bool insert(const K &key, shared_ptr<V> value) {
+    return insert(key, ::std::move(value), false);
+  }
+
+  // Returns true if `key` was inserted, false if its value was replaced.
+  bool insert_or_assign(const K &key, shared_ptr<V> value) {
+    return insert(key, ::std::move(value), true);
+  }
+
+  bool erase(const K &key) {
+    while (true) {
+      auto [pred, curr] = search(key);
+      if (!curr || less_(key, curr->key)) {
+        return false;
+      }
+      bool marked;
+      shared_ptr<node> succ = curr->next.load(&marked);
+      if (marked) {
+        continue; // Somebody else erased it; search() unlinks it.
+      }
+      // Marking is the linearization point; only one eraser wins.
+      if (!curr->next.try_mark(succ)) {
+        continue;
+      }
+      size_.fetch_sub(1, ::std::memory_order_relaxed);
+      if (!pred.links->compare_exchange(curr, false, succ, false)) {
+        search(key); // Unlink it on the slow path.
+      }
+      return true;
+    }
+  }
+
+  // Lock-free; never writes to the list.
+  shared_ptr<V> find(const K &key) const {
+    hazard_pointer hp[2];
+    snapshot n = lower_bound_node(key, hp);
+    if (n && !less_(key, n->key)) {
+      return n->value.load();
+    }
+    return nullptr;
+  }
+
+  bool contains(const K &key) const {
+    hazard_pointer hp[2];
+    snapshot n = lower_bound_node(key, hp);
+    return n && !less_(key, n->key);
+  }
+
+  // Calls `fn(key, value)` on every present entry in order, without taking a
+  // single reference. `fn` must not keep the value's address.
+  template <typename F> void for_each(F fn) const {
+    hazard_pointer hp[2];
+    hazard_pointer value_hp;
+    int c = 0, s = 1;
+    snapshot curr = head_.protect(hp[c]);
+    while (curr) {
+      snapshot succ = curr->next.protect(hp[s]);
+      if (!succ.marked()) {
+        if (const V *v = curr->value.protect(value_hp)) {
+          fn(curr->key, *v);
+        }
+      }
+      ::std::swap(c, s);
+      curr = succ;
+    }
+  }
+
+  iterator begin() const { return iterator(next_present(head_.load())); }
+
+  iterator end() const { return {}; }
+
+  // Approximate while writers are running.
+  ::std::size_t size() const {
+    return static_cast<::std::size_t>(
+        size_.load(::std::memory_order_relaxed));
+  }
+
+  bool empty() const { return !begin().node_; }
+
+private:
+  // Where a search stopped: the link before the key and the node owning it
+  // (null for the head), kept alive.
+  struct position {
+    shared_ptr<node> owner;
+    link *links;
+  };
+
+  link head_;
+  ::std::atomic<long> size_{0};
+  [[no_unique_address]] Compare less_;
+
+  static shared_ptr<node> next_present(shared_ptr<node> n) {
+    while (n && n->next.is_marked()) {
+      n = n->next.load();
+    }
+    return n;
+  }
+
+  // First present node whose key is not less than `key`, protected by one of
+  // `hp`. Steps over marked nodes instead of unlinking them.
+  snapshot lower_bound_node(const K &key, hazard_pointer (&hp)[2]) const {
+    int c = 0, s = 1;
+    snapshot curr = head_.protect(hp[c]);
+    while (curr) {
+      snapshot succ = curr->next.protect(hp[s]);
+      if (!succ.marked() && !less_(curr->key, key)) {
+        break;
+      }
+      ::std::swap(c, s);
+      curr = succ;
+    }
+    return curr;
+  }
+
+  // The predecessor link of `key` and the first node not less than it,
+  // unlinking marked nodes on the way.
+  ::std::pair<position, shared_ptr<node>> search(const K &key) {
+  retry:
+    position pred{nullptr, &head_};
+    shared_ptr<node> curr = head_.load();
+    while (curr) {
+      bool marked;
+      shared_ptr<node> succ = curr->next.load(&marked);
+      if (marked) {
+        if (!pred.links->compare_exchange(curr, false, succ, false)) {
+          goto retry;
+        }
+        curr = ::std::move(succ);
+        continue;
+      }
+      if (!less_(curr->key, key)) {
+        break;
+      }
+      pred = {curr, &curr->next};
+      curr = ::std::move(succ);
+    }
+    return {::std::move(pred), ::std::move(curr)};
+  }
+
+  bool insert(const K &key, shared_ptr<V> value, bool assign) {
+    shared_ptr<node> n;
+    while (true) {
+      auto [pred, curr] = search(key);
+      if (curr && !less_(key, curr->key)) {
+        if (assign) {
+          curr->value.store(::std::move(value));
+        }
+        return false;
+      }
+      if (!n) {
+        n = make_shared<node>(key, value);
+      }
+      n->next.store(curr);
+      if (pred.links->compare_exchange(curr, false, n, false)) {
+        size_.fetch_add(1, ::std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+};
+
+} // namespace lockfree
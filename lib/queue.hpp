@@ -0,0 +1,93 @@
+#pragma once
+
+#include <optional>
+#include <utility>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace lockfree {
+
+// Michael-Scott queue. Both ends and every link are atomic_shared_ptr, so a
+// node stays alive for as long as any thread still holds it, even after it has
+// been dequeued. Values are moved in and out; the queue never copies them.
+template <typename T> class queue {
+  struct node {
+    ::std::optional<T> value; // Empty for the dummy node.
+    atomic_shared_ptr<node> next;
+
+    node() = default;
+
+    template <typename... Args>
+    explicit node(::std::in_place_t, Args &&...args)
+        : value(::std::in_place, ::std::forward<Args>(args)...) {}
+
+    // A dequeued node still links to its successor, so a thread stalled on an
+    // old node can pin a long chain. Unlink it iteratively rather than
+    // recursing once per node. Nobody else can reach `next` of a node whose
+    // count dropped to zero.
+    ~node() {
+      shared_ptr<node> n = next.unsafe_take();
+      while (n && n.use_count() == 1) {
+        n = n->next.unsafe_take();
+      }
+    }
+  };
+
+public:
+  queue() {
+    auto dummy = make_shared<node>();
+    head_.store(dummy);
+    tail_.store(::std::move(dummy));
+  }
+
+  queue(const queue &) = delete;
+  queue &operator=(const queue &) = delete;
+
+  void push(T value) { emplace(::std::move(value)); }
+
+  template <typename... Args> void emplace(Args &&...args) {
+    // Qualified, or ADL on std::in_place_t also finds std::make_shared.
+    auto n = lockfree::make_shared<node>(::std::in_place,
+                                         ::std::forward<Args>(args)...);
+    while (true) {
+      shared_ptr<node> t = tail_.load();
+      shared_ptr<node> next = t->next.load();
+      if (!next) {
+        if (t->next.compare_exchange_weak(next, n)) {
+          // Swing the tail. If this fails somebody already helped.
+          tail_.compare_exchange_strong(t, ::std::move(n));
+          return;
+        }
+      } else {
+        // The tail is lagging; help it along before retrying.
+        tail_.compare_exchange_weak(t, ::std::move(next));
+      }
+    }
+  }
+
+  // Returns an empty optional if the queue is empty.
+  ::std::optional<T> try_pop() {
+    shared_ptr<node> h = head_.load();
+    while (true) {
+      shared_ptr<node> next = h->next.load();
+      if (!next) {
+        return ::std::nullopt;
+      }
+      if (head_.compare_exchange_weak(h, next)) {
+        // `next` is the new dummy. Only the thread that advanced the head
+        // touches its value.
+        ::std::optional<T> value = ::std::move(next->value);
+        next->value.reset();
+        return value;
+      }
+    }
+  }
+
+  bool empty() const { return !head_.load()->next.load(); }
+
+private:
+  atomic_shared_ptr<node> head_;
+  atomic_shared_ptr<node> tail_;
+};
+
+} // namespace lockfree
@@ -1,15 +1,26 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <functional>
 #include <memory>
+#include <new>
 #include <type_traits>
 #include <typeinfo>
 #include <utility>
 
+#include "slab_allocator.hpp"
+
+#ifdef LOCKFREE_PROFILE_SHARED
+#include "shared_ptr_profiler.hpp"
+#endif
+
 // Before implementing this, I've read
 // https://github.com/DanielLiamAnderson/atomic_shared_ptr. It's quite
 // enlightening and helps me understand the internals of a shared pointer.
@@ -19,75 +30,331 @@ namespace lockfree {
 // We don't have to implement a unique_ptr.
 using ::std::unique_ptr;
 
+// Set to true for types that are never referenced weakly. Their control
+// blocks drop the weak count, so the last release is a single RMW, and
+// weak_ptr<T> doesn't compile.
+template <typename T> struct disable_weak_ptr : ::std::false_type {};
+
+namespace detail {
+inline constexpr ::std::size_t cache_line_size = 64;
+} // namespace detail
+
+// Layouts for make_shared's single allocation. Packed puts the object right
+// after the counters, so both usually share a cache line. Isolated starts the
+// object on the next cache line and pads it to a whole one, so reference
+// counting doesn't false-share with readers of the object's fields.
+struct packed_layout_t {
+  template <typename T> static constexpr ::std::size_t alignment = alignof(T);
+};
+
+struct isolated_layout_t {
+  template <typename T>
+  static constexpr ::std::size_t alignment =
+      alignof(T) > detail::cache_line_size ? alignof(T)
+                                           : detail::cache_line_size;
+};
+
+inline constexpr packed_layout_t packed_layout{};
+inline constexpr isolated_layout_t isolated_layout{};
+
+// Reference counts shared between threads. `Order` is the decrement's
+// ordering: acq_rel, or release plus an acquire fence on the last one only.
+// Either way the last release sees every write made through other
+// references.
+template <::std::memory_order Order = ::std::memory_order_acq_rel>
+struct atomic_counter {
+  static_assert(Order == ::std::memory_order_acq_rel ||
+                Order == ::std::memory_order_release);
+
+  using type = ::std::atomic<int>;
+
+  static int load(const type &c) { return c.load(::std::memory_order_relaxed); }
+
+  // Returns the old count.
+  static int increment(type &c) {
+    return c.fetch_add(1, ::std::memory_order_relaxed);
+  }
+
+  // Returns whether the count dropped to zero.
+  static bool decrement(type &c) {
+    int old = c.fetch_sub(1, Order);
+    assert(old > 0);
+    if (old != 1) {
+      return false;
+    }
+    if constexpr (Order == ::std::memory_order_release) {
+      ::std::atomic_thread_fence(::std::memory_order_acquire);
+    }
+    return true;
+  }
+
+  // Increments unless the count is zero.
+  static bool try_increment(type &c) {
+    int n = c.load(::std::memory_order_relaxed);
+    while (n != 0) {
+      if (c.compare_exchange_weak(n, n + 1, ::std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Plain int counts, for pointers that never leave their thread.
+struct plain_counter {
+  using type = int;
+
+  static int load(const type &c) { return c; }
+
+  static int increment(type &c) { return c++; }
+
+  static bool decrement(type &c) {
+    assert(c > 0);
+    return --c == 0;
+  }
+
+  static bool try_increment(type &c) { return c != 0 && ++c; }
+};
+
+// Where make_basic_shared puts the object: in an allocation of its own, or
+// inside the control block with the given layout.
+struct separate_storage {};
+
+template <typename Layout = packed_layout_t> struct inline_storage {
+  using layout = Layout;
+};
+
+// What a basic_shared_ptr decides at compile time. `Counter` is one of the
+// counters above; without `Weak` no control block has a weak count, whatever
+// disable_weak_ptr says.
+template <typename Counter = atomic_counter<>, bool Weak = true,
+          typename Storage = separate_storage>
+struct shared_policy {
+  using counter = Counter;
+  static constexpr bool weak = Weak;
+  using storage = Storage;
+};
+
+using default_policy = shared_policy<>;
+
+template <typename T, typename Policy = default_policy> class basic_shared_ptr;
+template <typename T, typename Policy = default_policy> class basic_weak_ptr;
+template <typename T, typename Policy = default_policy>
+class basic_borrowed_ptr;
+
+template <typename T> using shared_ptr = basic_shared_ptr<T>;
+template <typename T> using weak_ptr = basic_weak_ptr<T>;
+
 namespace detail {
-struct control_block {
-  ::std::atomic<int> use_count;  // Strong count.
-  ::std::atomic<int> weak_count; // Weak count + !!(strong count).
+template <typename Counter> struct basic_weak_control_block;
+
+template <typename Counter> struct basic_control_block {
+  typename Counter::type use_count; // Strong count.
 
-  control_block() : use_count(1), weak_count(1) {}
+#ifdef LOCKFREE_CHECK_BORROWS
+  // Live borrowed_ptrs, which must all be gone when the object is destroyed.
+  // Changes the block's layout, so the whole program must agree on it.
+  typename Counter::type borrow_count{0};
+#endif
 
-  control_block(int use, int weak) : use_count(use), weak_count(weak) {}
+  explicit basic_control_block(int use = 1) : use_count(use) {}
 
-  virtual void destroy() = 0; // Called when use_count decrements to 0.
+  virtual void *getaddr() = 0; // The managed object, as seen by its owner.
 
-  // virtual void *getaddr() = 0;
+  // The same block if it keeps a weak count, null otherwise.
+  virtual basic_weak_control_block<Counter> *weak() { return nullptr; }
 
-  virtual ~control_block() = default;
+  virtual ~basic_control_block() = default;
 
+#ifdef LOCKFREE_HAVE_SLAB
+  // Blocks come from slab_allocator's size classes rather than malloc. The
+  // virtual destructor makes `delete` pass the size of the whole block.
+  static void *operator new(::std::size_t size) {
+    return slab_allocator::allocate(size);
+  }
+
+  static void *operator new(::std::size_t size, ::std::align_val_t align) {
+    return slab_allocator::allocate(size, ::std::size_t(align));
+  }
+
+  static void operator delete(void *p, ::std::size_t size) noexcept {
+    slab_allocator::deallocate(p, size);
+  }
+
+  static void operator delete(void *p, ::std::size_t size,
+                              ::std::align_val_t align) noexcept {
+    slab_allocator::deallocate(p, size, ::std::size_t(align));
+  }
+#endif
+
+  // Nothing revives a count from zero; weak_ptr::lock() has its own path.
   void increment_use_count() {
-    if (0 == use_count.fetch_add(1, ::std::memory_order_relaxed)) {
-      weak_count.fetch_add(1, ::std::memory_order_relaxed);
+    if (immortal()) {
+      return;
     }
+    [[maybe_unused]] int old_use_count = Counter::increment(use_count);
+    assert(old_use_count > 0);
   }
 
   void decrement_use_count() {
-    int old_use_count = use_count.fetch_sub(1, ::std::memory_order_relaxed);
-    assert(old_use_count > 0);
-    if (old_use_count == 1) {
-      destroy();
-      int old_weak_count = weak_count.fetch_sub(1, ::std::memory_order_relaxed);
-      assert(old_weak_count > 0);
-      if (old_weak_count == 1) {
-        delete this;
+    if (!immortal() && Counter::decrement(use_count)) {
+#ifdef LOCKFREE_CHECK_BORROWS
+      if (Counter::load(borrow_count) != 0) {
+        ::std::fputs("lockfree: object destroyed while borrowed\n", stderr);
+        ::std::abort();
       }
+#endif
+      unprofile();
+      release();
     }
   }
+
+  int load_use_count() const { return Counter::load(use_count); }
+
+  // Immortal blocks skip every count update, so copies of a shared sentinel
+  // only read its cache line. Set before the block is published.
+  bool immortal() const { return immortal_; }
+
+  void make_immortal() { immortal_ = true; }
+
+  // Takes a sampled block off the profiler's books. For owners that destroy
+  // the object themselves instead of through release().
+  void unprofile() {
+#ifdef LOCKFREE_PROFILE_SHARED
+    if (sampled_) {
+      shared_ptr_profiler::destroyed(this);
+      sampled_ = false;
+    }
+#endif
+  }
+
+protected:
+  // Called when use_count decrements to 0. Destroys the object, and the block
+  // too unless weak references keep it.
+  virtual void release() = 0;
+
+  // Offers a new block to the allocation-site profiler, if it's compiled in.
+  void profile([[maybe_unused]] const ::std::type_info &type,
+               [[maybe_unused]] ::std::size_t size,
+               [[maybe_unused]] bool approximate = false) {
+#ifdef LOCKFREE_PROFILE_SHARED
+    sampled_ = shared_ptr_profiler::sample(this, type, size, approximate);
+#endif
+  }
+
+private:
+  // Not a sentinel count: loading the count right before the RMW on it
+  // stalls store forwarding and slows down every mortal copy.
+  bool immortal_ = false;
+
+#ifdef LOCKFREE_PROFILE_SHARED
+  bool sampled_ = false; // Fits in the padding after immortal_.
+#endif
 };
 
-struct monostate {};
+// A control block that weak_ptr can observe.
+template <typename Counter>
+struct basic_weak_control_block : basic_control_block<Counter> {
+  typename Counter::type weak_count{1}; // Weak count + !!(strong count).
+
+  basic_weak_control_block *weak() override { return this; }
+
+  void increment_weak_count() {
+    if (!this->immortal()) {
+      Counter::increment(weak_count);
+    }
+  }
+
+  void decrement_weak_count() {
+    if (!this->immortal() && Counter::decrement(weak_count)) {
+      delete this;
+    }
+  }
+
+  // A new strong reference, unless the object is already gone.
+  bool try_increment_use_count() {
+    return this->immortal() || Counter::try_increment(this->use_count);
+  }
+};
+
+using control_block = basic_control_block<atomic_counter<>>;
+using weak_control_block = basic_weak_control_block<atomic_counter<>>;
+
+template <typename T, typename Policy = default_policy>
+using control_block_base = ::std::conditional_t<
+    Policy::weak && !disable_weak_ptr<::std::remove_cv_t<T>>::value,
+    basic_weak_control_block<typename Policy::counter>,
+    basic_control_block<typename Policy::counter>>;
+
+// The end of release() once the object is gone.
+template <typename Block> void release_block(Block *block) {
+  if constexpr (requires { block->decrement_weak_count(); }) {
+    block->decrement_weak_count();
+  } else {
+    delete block;
+  }
+}
+
+// Tag for the private constructor that takes over an existing reference.
+struct adopt_t {};
 
 template <typename T> struct DefaultDeleter {
-  void operator()(void *ptr) const {
+  void operator()(const void *ptr) const {
     if constexpr (::std::is_array_v<T>) {
-      using pointer_type = ::std::add_pointer_t<::std::remove_extent_t<T>>;
+      using pointer_type =
+          ::std::add_pointer_t<const ::std::remove_extent_t<T>>;
       delete[] static_cast<pointer_type>(ptr);
     } else {
-      delete static_cast<T *>(ptr);
+      delete static_cast<const T *>(ptr);
     }
   }
 };
+} // namespace detail
+
+// Set to true to destroy every T on the background reclaimer thread by
+// default, however the pointer was made. Wherever it's enabled,
+// background_reclaimer.hpp must be included.
+template <typename T> struct destroy_in_background : ::std::false_type {};
+
+template <typename T, typename Deleter = detail::DefaultDeleter<T>>
+struct background_deleter;
+
+namespace detail {
+// release() of a block that holds its object: `destroy(block)` destroys the
+// object and releases the block, on the reclaimer thread if T opted in.
+template <typename T, typename Block, typename Destroy>
+void release_object(Block *block, Destroy destroy) {
+  if constexpr (destroy_in_background<::std::remove_cv_t<T>>::value) {
+    background_deleter<Block, Destroy>{::std::move(destroy)}(block);
+  } else {
+    destroy(block);
+  }
+}
 
 template <typename T, typename Y>
-concept convertible = ::std::is_base_of_v<T, Y> || ::std::is_same_v<T, Y>;
+concept convertible = ::std::is_base_of_v<T, Y> || ::std::is_same_v<T, Y> ||
+                      ::std::is_same_v<T, const Y>;
 
-template <typename T> struct control_block_with_ptr : control_block {
+template <typename T, typename Policy = default_policy>
+struct control_block_with_ptr final : control_block_base<T, Policy> {
   using element_type =
       ::std::conditional_t<::std::is_array_v<T>, ::std::remove_extent_t<T>, T>;
 
   explicit control_block_with_ptr(element_type *ptr)
       : control_block_with_ptr(ptr, DefaultDeleter<T>()) {}
 
+  // Arrays are profiled by their element size, marked as approximate; the
+  // length isn't known here.
   template <typename Deleter>
   control_block_with_ptr(element_type *ptr, Deleter deleter)
       : ptr_(ptr), deleter_([deleter = std::move(deleter)](void *p) {
           deleter(static_cast<element_type *>(p));
-        }) {}
-
-  // void *getaddr() override { return static_cast<void *>(getptr()); }
+        }) {
+    this->profile(typeid(T), sizeof(element_type), ::std::is_array_v<T>);
+  }
 
-  void destroy() override {
-    deleter_(ptr_);
-    ptr_ = nullptr;
+  void *getaddr() override {
+    return const_cast<void *>(static_cast<const void *>(getptr()));
   }
 
 private:
@@ -95,90 +362,285 @@ private:
   ::std::function<void(void *)> deleter_;
 
   element_type *getptr() { return ptr_; }
+
+  // ptr_ stays as it is: atomic_weak_ptr calls getaddr() on expired blocks
+  // while other threads may be releasing them.
+  void release() override {
+    deleter_(const_cast<void *>(static_cast<const void *>(ptr_)));
+    release_block(this);
+  }
+};
+
+// Alignment of a block that holds a T at `Align` after a `Header`. Once T is
+// over-aligned, operator new takes the aligned path anyway, so the block is
+// also aligned to the power of two that holds it, up to a cache line: it then
+// spans no more lines than its size needs.
+template <typename T, typename Header, ::std::size_t Align>
+constexpr ::std::size_t inplace_alignment() {
+  ::std::size_t align = ::std::max(Align, alignof(Header));
+  if (alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    return align;
+  }
+  ::std::size_t size = (sizeof(Header) + align - 1) / align * align + sizeof(T);
+  return ::std::max(align, ::std::min(::std::bit_ceil(size), cache_line_size));
+}
+
+// A control block that holds its object in the same allocation. `Layout`
+// decides where the object goes relative to the counters.
+template <typename T, typename Layout, typename Policy = default_policy>
+struct alignas(inplace_alignment<T, control_block_base<T, Policy>,
+                                 Layout::template alignment<T>>())
+    control_block_inplace final : control_block_base<T, Policy> {
+  template <typename... Args> explicit control_block_inplace(Args &&...args) {
+    ::new (static_cast<void *>(storage_)) T(::std::forward<Args>(args)...);
+    this->profile(typeid(T), sizeof(T));
+  }
+
+  void *getaddr() override {
+    return const_cast<void *>(static_cast<const void *>(getptr()));
+  }
+
+  T *getptr() { return ::std::launder(reinterpret_cast<T *>(storage_)); }
+
+private:
+  alignas(Layout::template alignment<T>) unsigned char storage_[sizeof(T)];
+
+  void release() override {
+    release_object<T>(this, [](control_block_inplace *b) {
+      b->getptr()->~T();
+      release_block(b);
+    });
+  }
+};
+
+// control_block_inplace for allocate_shared. A copy of `Alloc` constructs
+// and destroys the object, and, rebound to the block, allocates and frees it.
+template <typename T, typename Alloc>
+struct alignas(inplace_alignment<T, control_block_base<T>, alignof(T)>())
+    control_block_allocated final : control_block_base<T> {
+  using object_allocator =
+      typename ::std::allocator_traits<Alloc>::template rebind_alloc<T>;
+  using block_allocator = typename ::std::allocator_traits<
+      Alloc>::template rebind_alloc<control_block_allocated>;
+
+  template <typename... Args>
+  static control_block_allocated *create(const Alloc &alloc, Args &&...args) {
+    using traits = ::std::allocator_traits<block_allocator>;
+    block_allocator a(alloc);
+    control_block_allocated *b = traits::allocate(a, 1);
+    try {
+      ::new (static_cast<void *>(b))
+          control_block_allocated(alloc, ::std::forward<Args>(args)...);
+    } catch (...) {
+      traits::deallocate(a, b, 1);
+      throw;
+    }
+    return b;
+  }
+
+  void *getaddr() override {
+    return const_cast<void *>(static_cast<const void *>(getptr()));
+  }
+
+  T *getptr() { return ::std::launder(reinterpret_cast<T *>(storage_)); }
+
+  // release_block() ends in `delete`; this hands the memory back to the
+  // allocator instead of operator delete.
+  void operator delete(control_block_allocated *b, ::std::destroying_delete_t) {
+    block_allocator a(b->alloc_);
+    b->~control_block_allocated();
+    ::std::allocator_traits<block_allocator>::deallocate(a, b, 1);
+  }
+
+private:
+  [[no_unique_address]] object_allocator alloc_;
+  alignas(T) unsigned char storage_[sizeof(T)];
+
+  template <typename... Args>
+  explicit control_block_allocated(const Alloc &alloc, Args &&...args)
+      : alloc_(alloc) {
+    ::std::allocator_traits<object_allocator>::construct(
+        alloc_, reinterpret_cast<T *>(storage_),
+        ::std::forward<Args>(args)...);
+    this->profile(typeid(T), sizeof(T));
+  }
+
+  void release() override {
+    release_object<T>(this, [](control_block_allocated *b) {
+      ::std::allocator_traits<object_allocator>::destroy(b->alloc_,
+                                                         b->getptr());
+      release_block(b);
+    });
+  }
 };
 
-// TODO: control_block_with_inplace_obj is incomplete.
-// I think only control_block_with_ptr can have a deleter.
-template <typename T> struct control_block_with_inplace_obj : control_block {
-  explicit control_block_with_inplace_obj(T obj)
-      : control_block(/* is this correct? */), obj_(std::move(obj)) {}
+// make_shared<T[]>'s block: the elements follow the counters in the same
+// allocation, which is sized for them and freed by hand.
+template <typename T>
+struct alignas(::std::max(alignof(control_block_base<T>),
+                          alignof(::std::remove_extent_t<T>)))
+    control_block_array final : control_block_base<T> {
+  using element_type = ::std::remove_extent_t<T>;
+
+  // n value-initialized elements.
+  static control_block_array *create(::std::size_t n) {
+    void *p = allocate(bytes(n));
+    auto b = ::new (p) control_block_array(n);
+    try {
+      ::std::uninitialized_value_construct_n(b->getptr(), n);
+    } catch (...) {
+      b->~control_block_array();
+      deallocate(p, bytes(n));
+      throw;
+    }
+    b->profile(typeid(T), n * sizeof(element_type));
+    return b;
+  }
 
-  // void *getaddr() override { return static_cast<void *>(getptr()); }
+  void *getaddr() override {
+    return const_cast<void *>(static_cast<const void *>(getptr()));
+  }
+
+  element_type *getptr() {
+    return ::std::launder(reinterpret_cast<element_type *>(this + 1));
+  }
 
-  void destroy() override {
-    obj_.~T();
-    empty_ = {};
+  void operator delete(control_block_array *b, ::std::destroying_delete_t) {
+    ::std::size_t size = bytes(b->n_);
+    b->~control_block_array();
+    deallocate(b, size);
   }
 
 private:
-  union {
-    T obj_;
-    monostate empty_;
-  };
+  ::std::size_t n_;
+
+  explicit control_block_array(::std::size_t n) : n_(n) {}
 
-  T *getptr() { return &obj_; }
+  // alignas makes the size a multiple of the element's alignment, so the
+  // elements start right after the block.
+  static ::std::size_t bytes(::std::size_t n) {
+    return sizeof(control_block_array) + n * sizeof(element_type);
+  }
+
+  static void *allocate(::std::size_t size) {
+#ifdef LOCKFREE_HAVE_SLAB
+    return slab_allocator::allocate(size, alignof(control_block_array));
+#else
+    return ::operator new(size,
+                          ::std::align_val_t(alignof(control_block_array)));
+#endif
+  }
+
+  static void deallocate(void *p, ::std::size_t size) noexcept {
+#ifdef LOCKFREE_HAVE_SLAB
+    slab_allocator::deallocate(p, size, alignof(control_block_array));
+#else
+    ::operator delete(p, size,
+                      ::std::align_val_t(alignof(control_block_array)));
+#endif
+  }
+
+  // Elements go in reverse order of construction.
+  void release() override {
+    release_object<T>(this, [](control_block_array *b) {
+      for (::std::size_t i = b->n_; i > 0; --i) {
+        ::std::destroy_at(b->getptr() + i - 1);
+      }
+      release_block(b);
+    });
+  }
 };
+
+template <typename T, typename Policy, typename Block>
+basic_shared_ptr<T, Policy> adopt_block(Block *block) noexcept;
+} // namespace detail
+
+namespace detail {
+template <typename T> struct shared_ptr_access;
+template <typename T> struct weak_ptr_access;
+
+template <typename T> auto default_deleter() {
+  if constexpr (destroy_in_background<::std::remove_cv_t<T>>::value) {
+    return background_deleter<T>{};
+  } else {
+    return DefaultDeleter<T>{};
+  }
+}
 } // namespace detail
 
-template <typename T> struct shared_ptr {
+// A shared pointer whose counting, weak support and make_basic_shared's
+// storage are fixed by `Policy` (see shared_policy). shared_ptr<T> is the one
+// with default_policy; pointers with different policies don't convert into
+// each other.
+template <typename T, typename Policy> class basic_shared_ptr {
 public:
-  template <typename Y> friend class shared_ptr;
+  template <typename Y, typename P> friend class basic_shared_ptr;
+  template <typename Y, typename P> friend class basic_weak_ptr;
+  template <typename Y, typename P> friend class basic_borrowed_ptr;
+  template <typename Y> friend struct detail::shared_ptr_access;
+  template <typename Y, typename P, typename Block>
+  friend basic_shared_ptr<Y, P> detail::adopt_block(Block *block) noexcept;
 
   using element_type =
       ::std::conditional_t<::std::is_array_v<T>, ::std::remove_extent_t<T>, T>;
 
   // Constructors from
   // https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr.
-  constexpr shared_ptr() noexcept : ptr_(nullptr), ctrl_(nullptr) {}
+  constexpr basic_shared_ptr() noexcept : ptr_(nullptr), ctrl_(nullptr) {}
 
-  constexpr shared_ptr(std::nullptr_t) noexcept
+  constexpr basic_shared_ptr(std::nullptr_t) noexcept
       : ptr_(nullptr), ctrl_(nullptr) {}
 
   template <typename Y>
     requires(detail::convertible<element_type, Y>)
-  explicit shared_ptr(Y *ptr) : shared_ptr(ptr, detail::DefaultDeleter<T>{}) {}
+  explicit basic_shared_ptr(Y *ptr)
+      : basic_shared_ptr(ptr, detail::default_deleter<T>()) {}
 
   template <class Y, class Deleter>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(Y *ptr, Deleter d) {
+  basic_shared_ptr(Y *ptr, Deleter d) {
     if (!ptr) {
       clear();
     } else {
       if (!(ptr_ = static_cast<element_type *>(ptr))) {
         throw ::std::bad_cast{};
       }
-      ctrl_ = new detail::control_block_with_ptr<T>(ptr_, std::move(d));
+      ctrl_ =
+          new detail::control_block_with_ptr<T, Policy>(ptr_, std::move(d));
     }
   }
 
   template <class Deleter>
-  shared_ptr(std::nullptr_t ptr, Deleter d)
-      : shared_ptr(static_cast<T *>(nullptr), std::move(d)) {}
+  basic_shared_ptr(std::nullptr_t ptr, Deleter d)
+      : basic_shared_ptr(static_cast<T *>(nullptr), std::move(d)) {}
 
   // TODO
   template <class Y, class Deleter, class Alloc>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(Y *ptr, Deleter d, Alloc alloc);
+  basic_shared_ptr(Y *ptr, Deleter d, Alloc alloc);
 
   template <class Deleter, class Alloc>
-  shared_ptr(std::nullptr_t ptr, Deleter d, Alloc alloc)
-      : shared_ptr(static_cast<T *>(nullptr), std::move(d), std::move(alloc)) {}
+  basic_shared_ptr(std::nullptr_t ptr, Deleter d, Alloc alloc)
+      : basic_shared_ptr(static_cast<T *>(nullptr), std::move(d),
+                         std::move(alloc)) {}
 
   // Aliasing constructors
   template <class Y>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(const shared_ptr<Y> &r, element_type *ptr) noexcept
-      : shared_ptr(r) {
+  basic_shared_ptr(const basic_shared_ptr<Y, Policy> &r,
+                   element_type *ptr) noexcept
+      : basic_shared_ptr(r) {
     ptr_ = ptr;
   }
 
   template <class Y>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(shared_ptr<Y> &&r, element_type *ptr) noexcept : shared_ptr(r) {
+  basic_shared_ptr(basic_shared_ptr<Y, Policy> &&r, element_type *ptr) noexcept
+      : basic_shared_ptr(r) {
     ptr_ = ptr;
   }
 
-  shared_ptr(const shared_ptr &r) noexcept {
+  basic_shared_ptr(const basic_shared_ptr &r) noexcept {
     if (!r.ctrl_) {
       clear();
     } else {
@@ -190,7 +652,7 @@ public:
 
   template <class Y>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(const shared_ptr<Y> &r) noexcept {
+  basic_shared_ptr(const basic_shared_ptr<Y, Policy> &r) noexcept {
     if (!r.ctrl_) {
       clear();
     } else {
@@ -201,7 +663,7 @@ public:
     }
   }
 
-  shared_ptr(shared_ptr &&r) noexcept {
+  basic_shared_ptr(basic_shared_ptr &&r) noexcept {
     clear();
     ::std::swap(ctrl_, r.ctrl_);
     ::std::swap(ptr_, r.ptr_);
@@ -209,7 +671,7 @@ public:
 
   template <class Y>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(shared_ptr<Y> &&r) noexcept {
+  basic_shared_ptr(basic_shared_ptr<Y, Policy> &&r) noexcept {
     if (!r.ctrl_) {
       clear();
     } else {
@@ -219,32 +681,38 @@ public:
     }
   }
 
-  // TODO: weak_ptr
-  // template <class Y> explicit shared_ptr(const std::weak_ptr<Y> &r);
+  template <class Y>
+    requires(detail::convertible<element_type, Y>)
+  explicit basic_shared_ptr(const basic_weak_ptr<Y, Policy> &r)
+      : basic_shared_ptr(r.lock()) {
+    if (!ctrl_) {
+      throw ::std::bad_weak_ptr{};
+    }
+  }
 
   template <class Y, class Deleter>
     requires(detail::convertible<element_type, Y>)
-  shared_ptr(unique_ptr<Y, Deleter> &&r) {
+  basic_shared_ptr(unique_ptr<Y, Deleter> &&r) {
     auto y = r.release();
     try {
-      new (this) shared_ptr(y, r.get_deleter());
+      new (this) basic_shared_ptr(y, r.get_deleter());
     } catch (...) {
       r.reset(y);
       throw;
     }
   }
 
-  ~shared_ptr() { reset(); }
+  ~basic_shared_ptr() { reset(); }
 
   // TODO: full list of operator= overloads
-  shared_ptr &operator=(const shared_ptr &r) noexcept {
-    shared_ptr temp{r};
+  basic_shared_ptr &operator=(const basic_shared_ptr &r) noexcept {
+    basic_shared_ptr temp{r};
     temp.swap(*this);
     return *this;
   }
 
-  shared_ptr &operator=(shared_ptr &&r) noexcept {
-    shared_ptr temp{r};
+  basic_shared_ptr &operator=(basic_shared_ptr &&r) noexcept {
+    basic_shared_ptr temp{::std::move(r)};
     temp.swap(*this);
     return *this;
   }
@@ -259,14 +727,14 @@ public:
   template <class Y>
     requires(detail::convertible<element_type, Y>)
   void reset(Y *ptr) {
-    shared_ptr temp{ptr};
+    basic_shared_ptr temp{ptr};
     temp.swap(*this);
   }
 
   template <class Y, class Deleter>
     requires(detail::convertible<element_type, Y>)
   void reset(Y *ptr, Deleter d) {
-    shared_ptr temp{ptr, std::move(d)};
+    basic_shared_ptr temp{ptr, std::move(d)};
     temp.swap(*this);
   }
 
@@ -275,28 +743,39 @@ public:
     requires(detail::convertible<element_type, Y>)
   void reset(Y *ptr, Deleter d, Alloc alloc);
 
-  void swap(shared_ptr &r) noexcept {
+  void swap(basic_shared_ptr &r) noexcept {
     ::std::swap(ptr_, r.ptr_);
     ::std::swap(ctrl_, r.ctrl_);
   }
 
-  T *get() const noexcept { return ptr_; }
+  element_type *get() const noexcept { return ptr_; }
 
   T &operator*() const noexcept { return *ptr_; }
 
   T *operator->() const noexcept { return ptr_; }
 
-  // TODO: element_type& operator[]( std::ptrdiff_t idx ) const;
+  element_type &operator[](::std::ptrdiff_t idx) const
+    requires(::std::is_array_v<T>)
+  {
+    return ptr_[idx];
+  }
 
   long use_count() const noexcept {
-    return ctrl_ ? ctrl_->use_count.load() : 0;
+    return ctrl_ ? ctrl_->load_use_count() : 0;
   }
 
   explicit operator bool() const noexcept { return ptr_ != nullptr; }
 
 private:
+  using control_block = detail::basic_control_block<typename Policy::counter>;
+
   element_type *ptr_;
-  detail::control_block *ctrl_;
+  control_block *ctrl_;
+
+  // Takes over a reference the caller already holds on `ctrl`.
+  basic_shared_ptr(detail::adopt_t, element_type *ptr,
+                   control_block *ctrl) noexcept
+      : ptr_(ptr), ctrl_(ctrl) {}
 
   void clear() {
     ptr_ = nullptr;
@@ -304,9 +783,209 @@ private:
   }
 };
 
-// TODO: For now, use an inefficient implementation.
-template <class T, class... Args> shared_ptr<T> make_shared(Args &&...args) {
-  return shared_ptr<T>(new T(std::forward<Args...>(args...)));
+// Observes an object without keeping it alive. Types with disable_weak_ptr
+// can't be observed, and saying weak_ptr<T> for one is a compile error.
+template <typename T, typename Policy> class basic_weak_ptr {
+  static_assert(Policy::weak, "The policy has no weak support");
+  static_assert(!disable_weak_ptr<::std::remove_cv_t<T>>::value,
+                "T is declared never to be referenced weakly");
+
+public:
+  template <typename Y, typename P> friend class basic_weak_ptr;
+  template <typename Y> friend struct detail::weak_ptr_access;
+
+  using element_type = typename basic_shared_ptr<T, Policy>::element_type;
+
+  constexpr basic_weak_ptr() noexcept = default;
+
+  // Throws bad_weak_ptr if `r` was converted from a type with
+  // disable_weak_ptr, whose block has no weak count.
+  template <typename Y>
+    requires(detail::convertible<element_type, Y>)
+  basic_weak_ptr(const basic_shared_ptr<Y, Policy> &r)
+      : ptr_(r.ptr_), ctrl_(observe(r.ctrl_)) {
+    static_assert(!disable_weak_ptr<::std::remove_cv_t<Y>>::value,
+                  "Y is declared never to be referenced weakly");
+  }
+
+  basic_weak_ptr(const basic_weak_ptr &r) noexcept
+      : ptr_(r.ptr_), ctrl_(r.ctrl_) {
+    if (ctrl_) {
+      ctrl_->increment_weak_count();
+    }
+  }
+
+  template <typename Y>
+    requires(detail::convertible<element_type, Y>)
+  basic_weak_ptr(const basic_weak_ptr<Y, Policy> &r) noexcept
+      : ptr_(r.ptr_), ctrl_(r.ctrl_) {
+    if (ctrl_) {
+      ctrl_->increment_weak_count();
+    }
+  }
+
+  basic_weak_ptr(basic_weak_ptr &&r) noexcept
+      : ptr_(::std::exchange(r.ptr_, nullptr)),
+        ctrl_(::std::exchange(r.ctrl_, nullptr)) {}
+
+  ~basic_weak_ptr() { reset(); }
+
+  basic_weak_ptr &operator=(basic_weak_ptr r) noexcept {
+    r.swap(*this);
+    return *this;
+  }
+
+  void reset() noexcept {
+    if (ctrl_) {
+      ctrl_->decrement_weak_count();
+    }
+    ptr_ = nullptr;
+    ctrl_ = nullptr;
+  }
+
+  void swap(basic_weak_ptr &r) noexcept {
+    ::std::swap(ptr_, r.ptr_);
+    ::std::swap(ctrl_, r.ctrl_);
+  }
+
+  long use_count() const noexcept {
+    return ctrl_ ? ctrl_->load_use_count() : 0;
+  }
+
+  bool expired() const noexcept { return use_count() == 0; }
+
+  basic_shared_ptr<T, Policy> lock() const noexcept {
+    if (ctrl_ && ctrl_->try_increment_use_count()) {
+      return basic_shared_ptr<T, Policy>(detail::adopt_t{}, ptr_, ctrl_);
+    }
+    return nullptr;
+  }
+
+private:
+  using counter = typename Policy::counter;
+  using control_block = detail::basic_control_block<counter>;
+  using weak_control_block = detail::basic_weak_control_block<counter>;
+
+  element_type *ptr_ = nullptr;
+  weak_control_block *ctrl_ = nullptr;
+
+  static weak_control_block *observe(control_block *c) {
+    if (!c) {
+      return nullptr;
+    }
+    weak_control_block *w = c->weak();
+    if (!w) {
+      throw ::std::bad_weak_ptr{};
+    }
+    w->increment_weak_count();
+    return w;
+  }
+};
+
+namespace detail {
+// Takes over the reference a new block starts with.
+template <typename T, typename Policy, typename Block>
+basic_shared_ptr<T, Policy> adopt_block(Block *block) noexcept {
+  return basic_shared_ptr<T, Policy>(adopt_t{}, block->getptr(), block);
+}
+} // namespace detail
+
+// make_shared for any policy; the object goes where Policy::storage says.
+template <class T, class Policy, class... Args>
+  requires(!::std::is_array_v<T>)
+basic_shared_ptr<T, Policy> make_basic_shared(Args &&...args) {
+  using storage = typename Policy::storage;
+  if constexpr (::std::is_same_v<storage, separate_storage>) {
+    return basic_shared_ptr<T, Policy>(new T(::std::forward<Args>(args)...));
+  } else {
+    using block = detail::control_block_inplace<T, typename storage::layout,
+                                                Policy>;
+    return detail::adopt_block<T, Policy>(
+        new block(::std::forward<Args>(args)...));
+  }
+}
+
+template <class T, class... Args>
+  requires(!::std::is_array_v<T>)
+shared_ptr<T> make_shared(packed_layout_t, Args &&...args) {
+  using block = detail::control_block_inplace<T, packed_layout_t>;
+  return detail::adopt_block<T, default_policy>(
+      new block(::std::forward<Args>(args)...));
+}
+
+template <class T, class... Args>
+  requires(!::std::is_array_v<T>)
+shared_ptr<T> make_shared(isolated_layout_t, Args &&...args) {
+  using block = detail::control_block_inplace<T, isolated_layout_t>;
+  return detail::adopt_block<T, default_policy>(
+      new block(::std::forward<Args>(args)...));
+}
+
+// One allocation for the object and its counters, from the slab allocator
+// unless it's too big or disabled.
+template <class T, class... Args>
+  requires(!::std::is_array_v<T>)
+shared_ptr<T> make_shared(Args &&...args) {
+  return make_shared<T>(packed_layout, ::std::forward<Args>(args)...);
+}
+
+// n value-initialized elements, in one allocation with the counters.
+template <class T>
+  requires(::std::is_unbounded_array_v<T>)
+shared_ptr<T> make_shared(::std::size_t n) {
+  return detail::adopt_block<T, default_policy>(
+      detail::control_block_array<T>::create(n));
+}
+
+// Like make_shared(packed_layout, ...), but memory comes from `alloc`.
+template <class T, class Alloc, class... Args>
+  requires(!::std::is_array_v<T>)
+shared_ptr<T> allocate_shared(const Alloc &alloc, Args &&...args) {
+  using block = detail::control_block_allocated<T, Alloc>;
+  return detail::adopt_block<T, default_policy>(
+      block::create(alloc, ::std::forward<Args>(args)...));
+}
+
+// Static storage for an object that is never destroyed, such as an interned
+// constant or a sentinel node. Copies of share() cost no RMW at all, and stay
+// valid through static destruction.
+template <typename T> class immortal {
+  using block = detail::control_block_inplace<T, packed_layout_t>;
+
+public:
+  template <typename... Args> explicit immortal(Args &&...args) {
+    auto b = ::new (static_cast<void *>(storage_))
+        block(::std::forward<Args>(args)...);
+    b->make_immortal();
+  }
+
+  immortal(const immortal &) = delete;
+  immortal &operator=(const immortal &) = delete;
+
+  T *get() const noexcept { return ctrl()->getptr(); }
+
+  T &operator*() const noexcept { return *get(); }
+
+  T *operator->() const noexcept { return get(); }
+
+  shared_ptr<T> share() const noexcept {
+    return detail::adopt_block<T, default_policy>(ctrl());
+  }
+
+private:
+  alignas(block) unsigned char storage_[sizeof(block)];
+
+  block *ctrl() const noexcept {
+    return ::std::launder(
+        reinterpret_cast<block *>(const_cast<unsigned char *>(storage_)));
+  }
+};
+
+// static const auto empty = make_immortal<std::string>();
+template <class T, class... Args>
+  requires(!::std::is_array_v<T>)
+immortal<T> make_immortal(Args &&...args) {
+  return immortal<T>(::std::forward<Args>(args)...);
 }
 
 } // namespace lockfree
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Sampled allocation-site profiling for control blocks, in the spirit of a
+// heap profiler's in-use view. Compiled in with -DLOCKFREE_PROFILE_SHARED,
+// which shared_ptr.hpp picks up; without it nothing here is ever called.
+
+namespace lockfree {
+
+// Samples about one in sample_rate() control block creations. Each sample
+// keeps the creating stack, the type and its size until the object is
+// destroyed. The gaps between samples are geometric, so every creation has
+// the same 1/rate chance whatever the allocation pattern. The rate starts at
+// 0, which samples nothing.
+class shared_ptr_profiler {
+public:
+  static constexpr int max_frames = 32;
+
+  // Live samples from one creation site, scaled up by the rate.
+  struct site {
+    ::std::string type;
+    ::std::size_t size; // Of one object.
+    // Arrays whose length wasn't known: size is one element's.
+    bool approximate;
+    long samples;
+    long estimated_objects;
+    long estimated_bytes;
+    ::std::vector<void *> frames;
+  };
+
+  class periodic_report;
+
+  static void set_sample_rate(long rate) {
+    rate_.store(rate, ::std::memory_order_relaxed);
+  }
+
+  static long sample_rate() { return rate_.load(::std::memory_order_relaxed); }
+
+  // Called for every new control block. Returns whether it was sampled, in
+  // which case destroyed() must follow when the object goes away.
+  static bool sample(const void *block, const ::std::type_info &type,
+                     ::std::size_t size, bool approximate = false) {
+    long rate = sample_rate();
+    if (rate <= 0) {
+      return false;
+    }
+    thread_local long countdown = next_interval(rate);
+    if (--countdown > 0) {
+      return false;
+    }
+    countdown = next_interval(rate);
+    record(block, type, size, approximate, rate);
+    return true;
+  }
+
+  static void destroyed(const void *block) {
+    auto &s = state::get();
+    ::std::lock_guard lk(s.mutex);
+    s.live.erase(block);
+  }
+
+  // Sites with live samples, most estimated bytes first.
+  static ::std::vector<site> live_sites() {
+    ::std::map<::std::pair<::std::vector<void *>, const ::std::type_info *>,
+               site>
+        by_site;
+    {
+      auto &s = state::get();
+      ::std::lock_guard lk(s.mutex);
+      for (auto &[block, x] : s.live) {
+        auto &entry = by_site[{x.frames, x.type}];
+        if (entry.samples++ == 0) {
+          entry.size = x.size;
+          entry.approximate = x.approximate;
+          entry.frames = x.frames;
+        }
+        entry.estimated_objects += x.rate;
+        entry.estimated_bytes += x.rate * long(x.size);
+      }
+    }
+    ::std::vector<site> sites;
+    for (auto &[key, entry] : by_site) {
+      entry.type = demangle(key.second->name());
+      sites.push_back(::std::move(entry));
+    }
+    ::std::sort(sites.begin(), sites.end(), [](auto &a, auto &b) {
+      return a.estimated_bytes > b.estimated_bytes;
+    });
+    return sites;
+  }
+
+  // Prints live_sites() with symbolized stacks. Function names need
+  // -rdynamic; otherwise addr2line resolves the module+offset frames.
+  static void report(::std::FILE *out = stderr) {
+    auto sites = live_sites();
+    long objects = 0, bytes = 0;
+    for (auto &x : sites) {
+      objects += x.estimated_objects;
+      bytes += x.estimated_bytes;
+    }
+    ::std::fprintf(out,
+                   "live shared objects by site: ~%ld objects, ~%ld bytes "
+                   "(1 in %ld sampled)\n",
+                   objects, bytes, sample_rate());
+    for (auto &x : sites) {
+      ::std::fprintf(out, "%12ld bytes %8ld objects  %s (%zu bytes %s)\n",
+                     x.estimated_bytes, x.estimated_objects, x.type.c_str(),
+                     x.size,
+                     x.approximate ? "per element, length unknown" : "each");
+      int n = int(x.frames.size());
+      char **symbols = ::backtrace_symbols(x.frames.data(), n);
+      for (int i = 0; symbols && i < n; ++i) {
+        ::std::fprintf(out, "      %s\n", symbols[i]);
+      }
+      ::std::free(symbols);
+    }
+    ::std::fflush(out);
+  }
+
+private:
+  struct sample_info {
+    const ::std::type_info *type;
+    ::std::size_t size;
+    bool approximate;
+    long rate; // What the rate was when this was taken.
+    ::std::vector<void *> frames;
+  };
+
+  struct state {
+    ::std::mutex mutex;
+    ::std::unordered_map<const void *, sample_info> live;
+
+    // Never destroyed: shared_ptrs in other statics may still die after
+    // this one's destructor would have run.
+    static state &get() {
+      static state *s = new state;
+      return *s;
+    }
+  };
+
+  static inline ::std::atomic<long> rate_{0};
+
+  static long next_interval(long rate) {
+    thread_local ::std::minstd_rand rng(::std::random_device{}());
+    return ::std::geometric_distribution<long>(1.0 / double(rate))(rng) + 1;
+  }
+
+  [[gnu::noinline]] static void record(const void *block,
+                                       const ::std::type_info &type,
+                                       ::std::size_t size, bool approximate,
+                                       long rate) {
+    void *frames[max_frames + 2];
+    int n = ::backtrace(frames, max_frames + 2);
+    // Drops record() and sample() themselves.
+    int skip = ::std::min(n, 2);
+    sample_info x{&type, size, approximate, rate, {frames + skip, frames + n}};
+    auto &s = state::get();
+    ::std::lock_guard lk(s.mutex);
+    s.live.insert_or_assign(block, ::std::move(x));
+  }
+
+  static ::std::string demangle(const char *name) {
+    int status = 0;
+    char *d = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    ::std::string result = status == 0 ? d : name;
+    ::std::free(d);
+    return result;
+  }
+};
+
+// Calls report() every `interval` on a thread of its own, until destroyed.
+class shared_ptr_profiler::periodic_report {
+public:
+  explicit periodic_report(::std::chrono::milliseconds interval,
+                           ::std::FILE *out = stderr)
+      : thread_([this, interval, out] {
+          ::std::unique_lock lk(mutex_);
+          while (!cv_.wait_for(lk, interval, [this] { return stop_; })) {
+            report(out);
+          }
+        }) {}
+
+  periodic_report(const periodic_report &) = delete;
+  periodic_report &operator=(const periodic_report &) = delete;
+
+  ~periodic_report() {
+    {
+      ::std::lock_guard lk(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+private:
+  ::std::mutex mutex_;
+  ::std::condition_variable cv_;
+  bool stop_ = false;
+  ::std::thread thread_;
+};
+
+} // namespace lockfree
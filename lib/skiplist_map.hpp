@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace lockfree {
+
+// Ordered map from K to shared_ptr<V>; the lock-free skiplist from Herlihy &
+// Shavit, "The Art of Multiprocessor Programming", chapter 14. A node is
+// erased by marking its links top-down; whoever walks past a marked link
+// unlinks the node at that level.
+//
+// Links are atomic_markable_shared_ptr, so a node lives as long as anything
+// links to it or a thread holds it. Lookups walk the list with hazard pointers
+// and only take a reference on what they return. Iterators hold their node and
+// are weakly consistent: they never dangle and see every key that is present
+// for the whole iteration, but may or may not see concurrent changes.
+template <typename K, typename V, typename Compare = ::std::less<K>>
+class skiplist_map {
+  static constexpr int max_level = 24;
+
+  struct node;
+  using link = atomic_markable_shared_ptr<node>;
+
+  struct node {
+    K key;
+    atomic_shared_ptr<V> value;
+    int height;
+    ::std::unique_ptr<link[]> next;
+
+    node(const K &k, shared_ptr<V> v, int h)
+        : key(k), value(::std::move(v)), height(h), next(new link[h]) {}
+
+    // Readers step from a node to its successor under hazard pointers alone,
+    // so a dead node retires its links rather than dropping them. That also
+    // frees a long unlinked chain one scan pass per node instead of
+    // recursively.
+    ~node() {
+      for (int i = 0; i < height; ++i) {
+        next[i].store(nullptr);
+      }
+    }
+  };
+
+  using snapshot = typename link::snapshot;
+
+  // Where a search stopped at one level: the links of the predecessor (the
+  // head or a node) and the node that owns them, kept alive.
+  struct position {
+    shared_ptr<node> owner;
+    link *links;
+  };
+
+public:
+  class iterator {
+  public:
+    using value_type = ::std::pair<const K &, shared_ptr<V>>;
+
+    iterator() = default;
+
+    const K &key() const { return node_->key; }
+
+    shared_ptr<V> value() const { return node_->value.load(); }
+
+    value_type operator*() const { return {key(), value()}; }
+
+    // Moves to the next key that is present, skipping erased nodes.
+    iterator &operator++() {
+      node_ = next_present(node_->next[0].load());
+      if (node_ && upper_ && !map_->less_(node_->key, *upper_)) {
+        node_ = nullptr;
+      }
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+      return node_.get() == other.node_.get();
+    }
+
+  private:
+    friend class skiplist_map;
+
+    iterator(const skiplist_map *map, shared_ptr<node> n, const K *upper)
+        : map_(map), node_(::std::move(n)), upper_(upper) {
+      if (node_ && upper_ && !map_->less_(node_->key, *upper_)) {
+        node_ = nullptr;
+      }
+    }
+
+    const skiplist_map *map_ = nullptr;
+    shared_ptr<node> node_;
+    const K *upper_ = nullptr; // Exclusive bound of a range, if any.
+  };
+
+  // The keys in [lo, hi), for range-for.
+  class range {
+  public:
+    iterator begin() const { return map_->make_iterator(lo_, &hi_); }
+
+    iterator end() const { return {}; }
+
+  private:
+    friend class skiplist_map;
+
+    range(const skiplist_map *map, K lo, K hi)
+        : map_(map), lo_(::std::move(lo)), hi_(::std::move(hi)) {}
+
+    const skiplist_map *map_;
+    K lo_;
+    K hi_;
+  };
+
+  skiplist_map() : head_(new link[max_level]) {}
+
+  skiplist_map(const skiplist_map &) = delete;
+  skiplist_map &operator=(const skiplist_map &) = delete;
+
+  ~skiplist_map() {
+    for (int i = 0; i < max_level; ++i) {
+      head_[i].store(nullptr);
+    }
+    hazard_pointer_domain::global().scan();
+  }
+
+  // Inserts only if `key` is absent. Returns whether it did.
+  bool insert(const K &key, shared_ptr<V> value) {
+    return insert(key, ::std::move(value), false);
+  }
+
+  // Returns true if `key` was inserted, false if its value was replaced.
+  bool insert_or_assign(const K &key, shared_ptr<V> value) {
+    return insert(key, ::std::move(value), true);
+  }
+
+  bool erase(const K &key) {
+    position preds[max_level];
+    shared_ptr<node> succs[max_level];
+    if (!find(key, preds, succs)) {
+      return false;
+    }
+    shared_ptr<node> victim = succs[0];
+    // Mark the upper levels first so nobody links new nodes behind them.
+    for (int level = victim->height - 1; level >= 1; --level) {
+      bool marked;
+      shared_ptr<node> succ = victim->next[level].load(&marked);
+      while (!marked) {
+        victim->next[level].try_mark(succ);
+        succ = victim->next[level].load(&marked);
+      }
+    }
+    // Marking level 0 is the linearization point; only one eraser wins.
+    bool marked;
+    shared_ptr<node> succ = victim->next[0].load(&marked);
+    while (!marked) {
+      if (victim->next[0].try_mark(succ)) {
+        size_.fetch_sub(1, ::std::memory_order_relaxed);
+        find(key, preds, succs); // Unlink it physically.
+        return true;
+      }
+      succ = victim->next[0].load(&marked);
+    }
+    return false;
+  }
+
+  // Lock-free; never writes to the list.
+  shared_ptr<V> find(const K &key) const {
+    hazard_pointer hp[3];
+    snapshot n = lower_bound_node(key, hp);
+    if (n && !less_(key, n->key)) {
+      return n->value.load();
+    }
+    return nullptr;
+  }
+
+  bool contains(const K &key) const {
+    hazard_pointer hp[3];
+    snapshot n = lower_bound_node(key, hp);
+    return n && !less_(key, n->key);
+  }
+
+  iterator begin() const { return iterator(this, first_present(), nullptr); }
+
+  iterator end() const { return {}; }
+
+  // First key not less than `key`.
+  iterator lower_bound(const K &key) const {
+    return make_iterator(key, nullptr);
+  }
+
+  range scan(K lo, K hi) const {
+    return range(this, ::std::move(lo), ::std::move(hi));
+  }
+
+  // Approximate while writers are running.
+  ::std::size_t size() const {
+    return static_cast<::std::size_t>(
+        size_.load(::std::memory_order_relaxed));
+  }
+
+private:
+  ::std::unique_ptr<link[]> head_;
+  ::std::atomic<long> size_{0};
+  [[no_unique_address]] Compare less_;
+
+  static int random_height() {
+    thread_local ::std::uint64_t state =
+        0x9e3779b97f4a7c15ull ^ reinterpret_cast<::std::uintptr_t>(&state);
+    // xorshift64; each extra level with probability 1/2.
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return 1 + __builtin_ctzll(state | (1ull << (max_level - 1)));
+  }
+
+  static shared_ptr<node> next_present(shared_ptr<node> n) {
+    while (n && n->next[0].is_marked()) {
+      n = n->next[0].load();
+    }
+    return n;
+  }
+
+  shared_ptr<node> first_present() const {
+    return next_present(head_[0].load());
+  }
+
+  iterator make_iterator(const K &lo, const K *upper) const {
+    hazard_pointer hp[3];
+    return iterator(this, lower_bound_node(lo, hp).share(), upper);
+  }
+
+  // First present node whose key is not less than `key`, protected by one of
+  // `hp`. Steps over marked nodes instead of unlinking them and takes no
+  // references, so readers don't contend on the counts of the upper levels.
+  snapshot lower_bound_node(const K &key, hazard_pointer (&hp)[3]) const {
+    const link *pred = head_.get();
+    int p = 0, c = 1, s = 2; // The slots protecting pred, curr and succ.
+    snapshot curr;
+    for (int level = max_level - 1; level >= 0; --level) {
+      curr = pred[level].protect(hp[c]);
+      while (curr) {
+        snapshot succ = curr->next[level].protect(hp[s]);
+        if (!succ.marked()) {
+          if (!less_(curr->key, key)) {
+            break;
+          }
+          pred = curr->next.get();
+          ::std::swap(p, c);
+        }
+        ::std::swap(c, s);
+        curr = succ;
+      }
+    }
+    return curr;
+  }
+
+  // Fills the predecessors and successors of `key` at every level, unlinking
+  // marked nodes on the way. Returns whether `key` is present.
+  bool find(const K &key, position *preds, shared_ptr<node> *succs) {
+  retry:
+    position pred{nullptr, head_.get()};
+    for (int level = max_level - 1; level >= 0; --level) {
+      shared_ptr<node> curr = pred.links[level].load();
+      while (curr) {
+        bool marked;
+        shared_ptr<node> succ = curr->next[level].load(&marked);
+        if (marked) {
+          if (!pred.links[level].compare_exchange(curr, false, succ, false)) {
+            goto retry;
+          }
+          curr = ::std::move(succ);
+          continue;
+        }
+        if (!less_(curr->key, key)) {
+          break;
+        }
+        pred = {curr, curr->next.get()};
+        curr = ::std::move(succ);
+      }
+      preds[level] = pred;
+      succs[level] = ::std::move(curr);
+    }
+    return succs[0] && !less_(key, succs[0]->key);
+  }
+
+  bool insert(const K &key, shared_ptr<V> value, bool assign) {
+    position preds[max_level];
+    shared_ptr<node> succs[max_level];
+    int height = random_height();
+    while (true) {
+      if (find(key, preds, succs)) {
+        if (assign) {
+          succs[0]->value.store(::std::move(value));
+        }
+        return false;
+      }
+      auto n = make_shared<node>(key, value, height);
+      for (int level = 0; level < height; ++level) {
+        n->next[level].store(succs[level]);
+      }
+      if (!preds[0].links[0].compare_exchange(succs[0], false, n, false)) {
+        continue;
+      }
+      size_.fetch_add(1, ::std::memory_order_relaxed);
+      // The key is in the map now; the upper levels are only shortcuts.
+      for (int level = 1; level < height; ++level) {
+        while (!preds[level].links[level].compare_exchange(succs[level], false,
+                                                          n, false)) {
+          find(key, preds, succs);
+          bool marked;
+          shared_ptr<node> succ = n->next[level].load(&marked);
+          if (marked) {
+            return true; // Erased meanwhile; don't bother linking it higher.
+          }
+          if (succ.get() != succs[level].get() &&
+              !n->next[level].compare_exchange(succ, false, succs[level],
+                                               false)) {
+            return true;
+          }
+        }
+      }
+      return true;
+    }
+  }
+};
+
+} // namespace lockfree
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Control blocks come from slab_allocator unless built with
+// -DLOCKFREE_NO_SLAB. ASan builds skip it too, since recycled slots would
+// hide use-after-free from it.
+#if !defined(LOCKFREE_NO_SLAB) && !defined(__SANITIZE_ADDRESS__)
+#define LOCKFREE_HAVE_SLAB 1
+#endif
+
+namespace lockfree {
+
+// A size-class allocator for control blocks. Classes go up in 16-byte steps
+// to 128 bytes, which covers the bare header, the header with a deleter and
+// small inline objects, then in 64-byte steps to max_size. Each class carves
+// slots out of 64 KiB slabs that are never returned.
+//
+// Every thread keeps two magazines of up to magazine_size free slots per
+// class, so allocating and freeing touch nothing shared. Only a thread that
+// runs out of both, or fills both, goes to the class's depot of magazines
+// under a mutex, once per magazine_size operations. Anything bigger than
+// max_size or aligned beyond a cache line goes to operator new.
+class slab_allocator {
+public:
+  static constexpr ::std::size_t slab_size = 64 * 1024;
+  static constexpr ::std::size_t max_size = 512;
+  static constexpr ::std::size_t max_align = 64;
+  static constexpr ::std::size_t magazine_size = 32;
+  static constexpr int classes = 14;
+
+  // What the calling thread allocated from slabs so far; only counted with
+  // -DLOCKFREE_SLAB_STATS.
+  struct usage {
+    long allocations;
+    long requested;
+    long usable;
+  };
+
+  static constexpr ::std::size_t class_size(int c) {
+    return c < 8 ? 16 * ::std::size_t(c + 1)
+                 : 128 + 64 * ::std::size_t(c - 7);
+  }
+
+  // The class that holds `size` bytes aligned to `align`, or -1 for none.
+  static constexpr int class_of(::std::size_t size, ::std::size_t align) {
+    if (align > max_align) {
+      return -1;
+    }
+    // Slabs are cache-line aligned and every class is a multiple of its
+    // alignment up to that, so rounding up to `align` is enough.
+    size = (::std::max(size, ::std::size_t(1)) + align - 1) / align * align;
+    if (size > max_size) {
+      return -1;
+    }
+    return size <= 128 ? int((size + 15) / 16) - 1
+                       : 8 + int((size - 129) / 64);
+  }
+
+  static void *
+  allocate(::std::size_t size,
+           ::std::size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    int c = class_of(size, align);
+    if (c < 0) {
+      return align > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                 ? ::operator new(size, ::std::align_val_t(align))
+                 : ::operator new(size);
+    }
+#ifdef LOCKFREE_SLAB_STATS
+    ++stats.allocations;
+    stats.requested += long(size);
+    stats.usable += long(class_size(c));
+#endif
+    thread_cache *tc = local();
+    if (!tc) {
+      return depot_pop(c);
+    }
+    magazine &m = tc->loaded[c];
+    if (!m.count) {
+      if (tc->previous[c].count) {
+        ::std::swap(m, tc->previous[c]);
+      } else {
+        m = refill(c);
+      }
+    }
+    node *n = m.head;
+    m.head = n->next;
+    --m.count;
+    return n;
+  }
+
+  static void
+  deallocate(void *p, ::std::size_t size,
+             ::std::size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__) noexcept {
+    int c = class_of(size, align);
+    if (c < 0) {
+      if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        ::operator delete(p, size, ::std::align_val_t(align));
+      } else {
+        ::operator delete(p, size);
+      }
+      return;
+    }
+    thread_cache *tc = local();
+    if (!tc) {
+      magazine single{::new (p) node{nullptr}, 1};
+      give(c, single);
+      return;
+    }
+    magazine &m = tc->loaded[c];
+    if (m.count == magazine_size) {
+      // The previous magazine is empty or full, and goes if full.
+      magazine &prev = tc->previous[c];
+      if (prev.count) {
+        give(c, prev);
+      }
+      prev = m;
+      m = {};
+    }
+    m.head = ::new (p) node{m.head};
+    ++m.count;
+  }
+
+  // Bytes of slabs carved so far, in use or free.
+  static ::std::size_t reserved_bytes() {
+    return slabs_.load(::std::memory_order_relaxed) * slab_size;
+  }
+
+  static usage thread_usage() {
+#ifdef LOCKFREE_SLAB_STATS
+    return stats;
+#else
+    return {0, 0, 0};
+#endif
+  }
+
+private:
+  struct node {
+    node *next;
+  };
+
+  struct magazine {
+    node *head = nullptr;
+    ::std::size_t count = 0;
+  };
+
+  struct thread_cache {
+    magazine loaded[classes];
+    magazine previous[classes];
+
+    // Blocks this thread still caches go to the depots for others.
+    ~thread_cache() {
+      exited = true;
+      for (int c = 0; c < classes; ++c) {
+        give(c, loaded[c]);
+        give(c, previous[c]);
+      }
+    }
+  };
+
+  struct alignas(64) depot {
+    ::std::mutex mutex;
+    ::std::vector<magazine> magazines;
+  };
+
+  static inline thread_local bool exited = false;
+  static inline ::std::atomic<::std::size_t> slabs_{0};
+#ifdef LOCKFREE_SLAB_STATS
+  static inline thread_local usage stats;
+#endif
+
+  // Null once the thread's cache is gone, for blocks that other
+  // thread_locals free as the thread exits.
+  static thread_cache *local() {
+    if (exited) {
+      return nullptr;
+    }
+    thread_local thread_cache cache;
+    return &cache;
+  }
+
+  // Never destroyed: blocks may be freed after static destructors ran.
+  static depot &depot_of(int c) {
+    static depot *d = new depot[classes];
+    return d[c];
+  }
+
+  static void give(int c, magazine &m) {
+    if (m.count) {
+      depot &d = depot_of(c);
+      ::std::lock_guard lk(d.mutex);
+      d.magazines.push_back(m);
+    }
+    m = {};
+  }
+
+  // A magazine from the depot, or else a fresh slab's worth of them.
+  static magazine refill(int c) {
+    depot &d = depot_of(c);
+    ::std::lock_guard lk(d.mutex);
+    if (d.magazines.empty()) {
+      carve(c, d);
+    }
+    magazine m = d.magazines.back();
+    d.magazines.pop_back();
+    return m;
+  }
+
+  // One slot, for a thread whose cache is gone.
+  static void *depot_pop(int c) {
+    depot &d = depot_of(c);
+    ::std::lock_guard lk(d.mutex);
+    if (d.magazines.empty()) {
+      carve(c, d);
+    }
+    magazine &m = d.magazines.back();
+    node *n = m.head;
+    m.head = n->next;
+    if (--m.count == 0) {
+      d.magazines.pop_back();
+    }
+    return n;
+  }
+
+  static void carve(int c, depot &d) {
+    auto slab = static_cast<unsigned char *>(
+        ::operator new(slab_size, ::std::align_val_t(max_align)));
+    slabs_.fetch_add(1, ::std::memory_order_relaxed);
+    ::std::size_t size = class_size(c);
+    ::std::size_t slots = slab_size / size;
+    for (::std::size_t first = 0; first < slots; first += magazine_size) {
+      magazine m;
+      for (::std::size_t i = ::std::min(slots, first + magazine_size);
+           i-- > first;) {
+        m.head = ::new (slab + i * size) node{m.head};
+        ++m.count;
+      }
+      d.magazines.push_back(m);
+    }
+  }
+};
+
+} // namespace lockfree
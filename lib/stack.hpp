@@ -0,0 +1,93 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace lockfree {
+
+// Treiber stack. Nodes are owned by shared_ptr and the head is an
+// atomic_shared_ptr, so a node can't be freed, let alone reused, while another
+// thread still looks at it. That is what rules out ABA.
+template <typename T> class stack {
+  struct node {
+    shared_ptr<T> value;
+    shared_ptr<node> next; // Never changes once the node is published.
+
+    // Unlink iteratively so dropping a long chain doesn't recurse once per
+    // node.
+    ~node() {
+      shared_ptr<node> n = ::std::move(next);
+      while (n && n.use_count() == 1) {
+        n = ::std::move(n->next);
+      }
+    }
+  };
+
+public:
+  stack() = default;
+
+  stack(const stack &) = delete;
+  stack &operator=(const stack &) = delete;
+
+  void push(T value) { push(make_shared<T>(::std::move(value))); }
+
+  void push(shared_ptr<T> value) {
+    auto n = make_shared<node>();
+    n->value = ::std::move(value);
+    n->next = head_.load();
+    while (!head_.compare_exchange_weak(n->next, n)) {
+    }
+  }
+
+  // Pushes [first, last) with a single CAS. The result is the same as pushing
+  // the elements one by one, so *(last - 1) ends up on top.
+  template <typename It> void push_range(It first, It last) {
+    if (first == last) {
+      return;
+    }
+    auto bottom = make_shared<node>();
+    bottom->value = make_shared<T>(*first);
+    auto top = bottom;
+    for (++first; first != last; ++first) {
+      auto n = make_shared<node>();
+      n->value = make_shared<T>(*first);
+      n->next = ::std::move(top);
+      top = ::std::move(n);
+    }
+    bottom->next = head_.load();
+    while (!head_.compare_exchange_weak(bottom->next, top)) {
+    }
+  }
+
+  // Returns nullptr if the stack is empty.
+  shared_ptr<T> try_pop() {
+    shared_ptr<node> old = head_.load();
+    while (old && !head_.compare_exchange_weak(old, old->next)) {
+    }
+    if (!old) {
+      return nullptr;
+    }
+    // Only the thread that unlinked the node touches its value.
+    return ::std::move(old->value);
+  }
+
+  // Detaches the whole stack at once. Values come out top first.
+  ::std::vector<shared_ptr<T>> pop_all() {
+    ::std::vector<shared_ptr<T>> values;
+    // Other threads may still read `next` of the detached nodes, so walk the
+    // chain without modifying it.
+    for (shared_ptr<node> n = head_.exchange(nullptr); n; n = n->next) {
+      values.push_back(::std::move(n->value));
+    }
+    return values;
+  }
+
+  bool empty() const { return !head_.load(); }
+
+private:
+  atomic_shared_ptr<node> head_;
+};
+
+} // namespace lockfree
@@ -0,0 +1,139 @@
+#include "arena.hpp"
+#include <cassert>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+using namespace lockfree;
+
+struct Node {
+  static std::vector<int> destroyed;
+
+  int id;
+  std::string name;
+  shared_ptr<Node> next;
+  weak_ptr<Node> parent;
+
+  explicit Node(int i) : id(i), name("node " + std::to_string(i)) {}
+  ~Node() { destroyed.push_back(id); }
+};
+std::vector<int> Node::destroyed;
+
+struct Plain {
+  long a, b;
+};
+
+struct alignas(64) Aligned {
+  int value = 7;
+};
+
+void test_lifetime() {
+  arena a;
+  Node::destroyed.clear();
+  {
+    auto first = make_shared_in<Node>(a, 1);
+    auto second = make_shared_in<Node>(a, 2);
+    first->next = second;
+    second->parent = first;
+    assert(second->parent.lock().get() == first.get());
+    auto copy = first;
+    assert(copy->name == "node 1");
+    assert(copy->next->id == 2);
+  }
+  // Nothing dies before reset(), then everything does, newest first.
+  assert(Node::destroyed.empty());
+  a.reset();
+  assert((Node::destroyed == std::vector<int>{2, 1}));
+}
+
+void test_cycle() {
+  arena a;
+  Node::destroyed.clear();
+  {
+    auto x = make_shared_in<Node>(a, 1);
+    auto y = make_shared_in<Node>(a, 2);
+    x->next = y;
+    y->next = x;
+  }
+  a.reset();
+  assert(Node::destroyed.size() == 2);
+}
+
+void test_memory() {
+  arena a(4096);
+  for (int i = 0; i < 1000; ++i) {
+    auto p = make_shared_in<Plain>(a, Plain{i, i});
+    assert(p->a == i);
+  }
+  assert(a.capacity() > 4096);
+  a.reset();
+  assert(a.capacity() == 4096);
+  // Bigger than a chunk.
+  a.allocate(10000, 16);
+  assert(a.capacity() > 10000);
+  a.reset();
+  for (int i = 0; i < 10; ++i) {
+    auto p = make_shared_in<Aligned>(a);
+    assert(reinterpret_cast<std::uintptr_t>(p.get()) % 64 == 0);
+    assert(p->value == 7);
+  }
+}
+
+void test_threads() {
+  arena a;
+  Node::destroyed.clear();
+  {
+    auto root = make_shared_in<Node>(a, 0);
+    std::vector<std::thread> ts;
+    for (int t = 0; t < 4; ++t) {
+      ts.emplace_back([root] {
+        for (int i = 0; i < 10000; ++i) {
+          shared_ptr<Node> copy = root;
+          assert(copy->id == 0);
+        }
+      });
+    }
+    for (auto &t : ts) {
+      t.join();
+    }
+  }
+  a.reset();
+  assert(Node::destroyed.size() == 1);
+}
+
+// A pointer kept past reset() trips the debug check.
+void test_escape() {
+#ifndef NDEBUG
+  for (bool weak : {false, true}) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      std::freopen("/dev/null", "w", stderr);
+      arena a;
+      auto p = make_shared_in<Node>(a, 1);
+      weak_ptr<Node> w = p;
+      if (weak) {
+        p.reset();
+      }
+      a.reset();
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  }
+#endif
+}
+
+int main() {
+  test_lifetime();
+  test_cycle();
+  test_memory();
+  test_threads();
+  test_escape();
+  std::cout << "All tests passed!" << std::endl;
+}
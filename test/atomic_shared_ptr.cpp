@@ -0,0 +1,204 @@
+#include "atomic_shared_ptr.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+// Counts allocations, so tests can check that a path doesn't allocate.
+static std::atomic<long> allocations = 0;
+
+void *operator new(std::size_t n) {
+  ++allocations;
+  if (void *p = std::malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+struct Job {
+  int id;
+  explicit Job(int i) : id(i) {}
+};
+
+void test_wait_returns_when_changed() {
+  atomic_shared_ptr<Job> a(make_shared<Job>(1));
+  auto old = a.load();
+  a.store(make_shared<Job>(2));
+  a.wait(old); // Already different.
+  a.wait(nullptr);
+
+  // An aliasing value never matches what's stored.
+  static Job other(3);
+  shared_ptr<Job> alias(shared_ptr<Job>(old), &other);
+  atomic_shared_ptr<Job> b(alias);
+  b.wait(alias);
+}
+
+void test_notify_one() {
+  atomic_shared_ptr<Job> a(make_shared<Job>(1));
+  std::atomic<bool> woken = false;
+  std::thread waiter([&] {
+    a.wait(a.load());
+    assert(a.load()->id == 2);
+    woken = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  assert(!woken);
+  a.store(make_shared<Job>(2));
+  a.notify_one();
+  waiter.join();
+  assert(woken);
+}
+
+// Waiters follow a sequence of jobs; each sees the last one eventually.
+void test_notify_all() {
+  constexpr int waiters = 4, jobs = 200;
+  atomic_shared_ptr<Job> a(make_shared<Job>(0));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < waiters; ++t) {
+    threads.emplace_back([&] {
+      shared_ptr<Job> seen = a.load();
+      while (seen->id != jobs) {
+        a.wait(seen);
+        shared_ptr<Job> next = a.load();
+        assert(next->id > seen->id);
+        seen = next;
+      }
+    });
+  }
+  for (int i = 1; i <= jobs; ++i) {
+    a.store(make_shared<Job>(i));
+    a.notify_all();
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+struct Tag {
+  long tag = 0;
+};
+
+struct Named : Tag, Job {
+  Named(int i) : Job(i) {}
+};
+
+void test_weak_load_store() {
+  auto p = make_shared<Job>(1);
+  atomic_weak_ptr<Job> a(p);
+  assert(a.load().lock().get() == p.get());
+  assert(p.use_count() == 1);
+
+  auto q = make_shared<Job>(2);
+  a.store(q);
+  assert(a.load().lock()->id == 2);
+  weak_ptr<Job> old = a.exchange(p);
+  assert(old.lock().get() == q.get());
+  assert(a.load().lock().get() == p.get());
+
+  p.reset();
+  assert(a.load().expired());
+  assert(!a.load().lock());
+
+  a.store(weak_ptr<Job>());
+  assert(!a.load().lock());
+}
+
+void test_weak_aliasing() {
+  // Job sits after Tag in Named, so this weak_ptr<Job> is aliasing.
+  shared_ptr<Named> n = make_shared<Named>(7);
+  shared_ptr<Job> job = n;
+  atomic_weak_ptr<Job> a(weak_ptr<Job>{job});
+  assert(a.load().lock().get() == job.get());
+  assert(a.load().lock()->id == 7);
+
+  // Aliasing values compare by value.
+  weak_ptr<Job> expected = job;
+  assert(a.compare_exchange_strong(expected, weak_ptr<Job>()));
+  assert(a.load().expired());
+  assert(!a.compare_exchange_strong(expected, weak_ptr<Job>()));
+  assert(expected.expired());
+}
+
+void test_weak_compare_exchange() {
+  auto p = make_shared<Job>(1), q = make_shared<Job>(2);
+  atomic_weak_ptr<Job> a(p);
+  weak_ptr<Job> expected = q;
+  assert(!a.compare_exchange_strong(expected, q));
+  assert(expected.lock().get() == p.get());
+  assert(a.compare_exchange_strong(expected, q));
+  assert(a.load().lock().get() == q.get());
+
+  expected = q;
+  while (!a.compare_exchange_weak(expected, weak_ptr<Job>())) {
+  }
+  assert(a.load().expired());
+}
+
+void test_weak_lock_does_not_allocate() {
+  auto p = make_shared<Job>(1);
+  atomic_weak_ptr<Job> a(p);
+  a.load().lock(); // Sets up the thread's hazard pointer record.
+  long before = allocations;
+  for (int i = 0; i < 1000; ++i) {
+    assert(a.load().lock()->id == 1);
+  }
+  assert(allocations == before);
+}
+
+// Readers upgrade while writers keep replacing the slot and the objects die.
+void test_weak_concurrent() {
+  constexpr int readers = 3, rounds = 20000;
+  atomic_weak_ptr<Job> slot(make_shared<Job>(0));
+  std::atomic<bool> done = false;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < readers; ++t) {
+    threads.emplace_back([&] {
+      while (!done) {
+        if (auto p = slot.load().lock()) {
+          assert(p->id >= 0 && p->id <= rounds);
+        }
+      }
+    });
+  }
+  std::thread writer([&] {
+    auto keep = make_shared<Job>(0);
+    for (int i = 1; i <= rounds; ++i) {
+      auto p = make_shared<Job>(i);
+      if (i % 2) {
+        slot.store(p);
+      } else {
+        weak_ptr<Job> expected = slot.load();
+        slot.compare_exchange_strong(expected, p);
+      }
+      if (i % 8 == 0) {
+        keep = p; // Survives the round, so readers see live objects too.
+      }
+    }
+    done = true;
+  });
+  writer.join();
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+int main() {
+  test_wait_returns_when_changed();
+  test_notify_one();
+  test_notify_all();
+  test_weak_load_store();
+  test_weak_aliasing();
+  test_weak_compare_exchange();
+  test_weak_lock_does_not_allocate();
+  test_weak_concurrent();
+  std::cout << "All tests passed!" << std::endl;
+}
@@ -0,0 +1,146 @@
+#include "background_reclaimer.hpp"
+#include "object_pool.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+// Records the thread that destroyed it.
+struct Tracked {
+  static std::atomic<int> alive;
+
+  std::thread::id *destroyed_on;
+
+  explicit Tracked(std::thread::id *where = nullptr) : destroyed_on(where) {
+    ++alive;
+  }
+  ~Tracked() {
+    if (destroyed_on) {
+      *destroyed_on = std::this_thread::get_id();
+    }
+    --alive;
+  }
+};
+std::atomic<int> Tracked::alive = 0;
+
+struct Graph : Tracked {
+  std::vector<shared_ptr<Graph>> children;
+};
+
+namespace lockfree {
+template <> struct destroy_in_background<Graph> : std::true_type {};
+} // namespace lockfree
+
+void test_inline_by_default() {
+  std::thread::id where;
+  lockfree::make_shared<Tracked>(&where).reset();
+  assert(where == std::this_thread::get_id());
+  assert(Tracked::alive == 0);
+}
+
+void test_per_call() {
+  std::thread::id where;
+  auto p = lockfree::make_shared<Tracked>(background_destroy, &where);
+  p.reset();
+  background_reclaimer::global().drain();
+  assert(where != std::thread::id{});
+  assert(where != std::this_thread::get_id());
+  assert(Tracked::alive == 0);
+}
+
+void test_per_type() {
+  std::thread::id where;
+  {
+    auto root = make_shared<Graph>();
+    root->destroyed_on = &where;
+    for (int i = 0; i < 100; ++i) {
+      auto child = make_shared<Graph>();
+      child->children.push_back(make_shared<Graph>());
+      root->children.push_back(std::move(child));
+    }
+    shared_ptr<Graph> copy{new Graph};
+  }
+  // Each child was deferred by the deleter of its parent; drain() waits for
+  // those as well.
+  background_reclaimer::global().drain();
+  assert(where != std::this_thread::get_id());
+  assert(Tracked::alive == 0);
+  assert(background_reclaimer::global().pending() == 0);
+}
+
+// The trait holds however the object was made, including the paths that
+// put it next to its control block.
+void test_per_type_every_path() {
+  using inline_policy =
+      shared_policy<atomic_counter<>, true, inline_storage<isolated_layout_t>>;
+  object_pool<Graph> pool;
+  std::vector<std::thread::id> where(6);
+  {
+    std::vector<shared_ptr<Graph>> v;
+    v.push_back(make_shared<Graph>(packed_layout));
+    v.push_back(make_shared<Graph>(isolated_layout));
+    v.push_back(allocate_shared<Graph>(std::allocator<Graph>()));
+    v.push_back(make_pooled(pool));
+    v.push_back(make_shared<Graph>());
+    weak_ptr<Graph> w = v[0];
+    auto b = make_basic_shared<Graph, inline_policy>();
+    for (std::size_t i = 0; i < v.size(); ++i) {
+      v[i]->destroyed_on = &where[i];
+    }
+    b->destroyed_on = &where[5];
+    v.clear();
+    b.reset();
+    assert(w.expired());
+  }
+  background_reclaimer::global().drain();
+  for (auto &id : where) {
+    assert(id != std::thread::id{});
+    assert(id != std::this_thread::get_id());
+  }
+  assert(Tracked::alive == 0);
+}
+
+void test_custom_deleter() {
+  std::atomic<int> deleted = 0;
+  auto deleter = [&](int *p) {
+    ++deleted;
+    delete p;
+  };
+  shared_ptr<int> p(new int(1),
+                    background_deleter<int, decltype(deleter)>{deleter});
+  p.reset();
+  background_reclaimer::global().drain();
+  assert(deleted == 1);
+}
+
+void test_concurrent() {
+  constexpr int threads = 4;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([] {
+      for (int i = 0; i < 10000; ++i) {
+        make_shared<Tracked>(background_destroy);
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  background_reclaimer::global().drain();
+  assert(Tracked::alive == 0);
+}
+
+int main() {
+  test_inline_by_default();
+  test_per_call();
+  test_per_type();
+  test_per_type_every_path();
+  test_custom_deleter();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include "borrowed_ptr.hpp"
+#include <cassert>
+#include <csignal>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace lockfree;
+
+struct Base {
+  virtual ~Base() = default;
+  int id = 1;
+};
+
+struct Derived : Base {
+  Derived() { id = 2; }
+};
+
+int depth(borrowed_ptr<Base> p, int n) {
+  return n == 0 ? p->id : depth(p, n - 1);
+}
+
+// Keeps what it's given, like a callee storing a callback's target.
+shared_ptr<Base> kept;
+
+void keep(borrowed_ptr<Base> p) { kept = p.share(); }
+
+void test_borrow() {
+  auto p = make_shared<Derived>();
+  borrowed_ptr<Derived> b = p;
+  assert(b.get() == p.get());
+  assert(b->id == 2);
+  // Borrowing and passing down doesn't touch the count.
+  assert(depth(b, 100) == 2);
+  assert(depth(p, 100) == 2);
+  assert(p.use_count() == 1);
+  assert(b.use_count() == 1);
+
+  keep(b);
+  assert(p.use_count() == 2);
+  assert(kept.get() == p.get());
+  kept.reset();
+
+  borrowed_ptr<Base> empty;
+  assert(!empty);
+  assert(!empty.share());
+  assert(empty.use_count() == 0);
+  empty = b;
+  assert(empty.get() == p.get());
+}
+
+void test_outlive() {
+#ifdef LOCKFREE_CHECK_BORROWS
+  // A borrow that outlives the object aborts when borrows are checked.
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(STDERR_FILENO); // Keep the expected assertion message quiet.
+    auto p = make_shared<Base>();
+    borrowed_ptr<Base> b = p;
+    p.reset();
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+#endif
+}
+
+int main() {
+  test_borrow();
+  test_outlive();
+  std::cout << "All tests passed!" << std::endl;
+}
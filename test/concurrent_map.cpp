@@ -0,0 +1,134 @@
+#include "concurrent_map.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+using namespace lockfree;
+
+void test_basic() {
+  concurrent_map<std::string, int> m;
+  assert(!m.find("a"));
+  assert(m.insert("a", make_shared<int>(1)));
+  assert(!m.insert("a", make_shared<int>(2)));
+  assert(*m.find("a") == 1);
+
+  assert(!m.insert_or_assign("a", make_shared<int>(3)));
+  assert(*m.find("a") == 3);
+  assert(m.insert_or_assign("b", make_shared<int>(4)));
+  assert(m.size() == 2);
+
+  assert(m.erase("a"));
+  assert(!m.erase("a"));
+  assert(!m.contains("a"));
+  assert(m.size() == 1);
+}
+
+void test_guarded() {
+  concurrent_map<int, int> m;
+  auto v = make_shared<int>(42);
+  m.insert(1, v);
+  {
+    auto g = m.find_guarded(1);
+    assert(g && *g == 42);
+    // No reference was taken.
+    assert(v.use_count() == 2);
+
+    // The old value stays readable through the guard after it's replaced.
+    m.insert_or_assign(1, make_shared<int>(7));
+    assert(*g == 42);
+  }
+  assert(!m.find_guarded(2));
+  assert(*m.find(1) == 7);
+}
+
+// Holding too many guarded results is a hard failure, not a write past the
+// thread's hazard slots, in every build.
+void test_guard_exhaustion() {
+  concurrent_map<int, int> m;
+  m.insert(1, make_shared<int>(1));
+  {
+    auto a = m.find_guarded(1);
+    auto b = m.find_guarded(1);
+    assert(*a == 1 && *b == 1);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    std::freopen("/dev/null", "w", stderr);
+    // Two slots each without a resize in progress.
+    std::vector<guarded_ptr<const int>> held;
+    for (int i = 0; i < 5; ++i) {
+      held.push_back(m.find_guarded(1));
+    }
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
+
+void test_grow() {
+  concurrent_map<int, int> m;
+  constexpr int n = 10000;
+  for (int i = 0; i < n; ++i) {
+    m.insert(i, make_shared<int>(i));
+    // Every key stays visible while the table is being migrated.
+    assert(*m.find(i / 2) == i / 2);
+  }
+  assert(m.size() == n);
+  assert(m.bucket_count() >= n / 2);
+  for (int i = 0; i < n; ++i) {
+    assert(*m.find(i) == i);
+  }
+}
+
+void test_concurrent() {
+  constexpr int threads = 4;
+  constexpr int per_thread = 5000;
+  concurrent_map<int, int> m;
+  std::atomic<int> misses = 0;
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < per_thread; ++i) {
+        int key = t * per_thread + i;
+        m.insert(key, make_shared<int>(key));
+        m.insert_or_assign(key, make_shared<int>(-key));
+        // Keys written by this thread must be visible to it.
+        auto g = m.find_guarded(key);
+        if (!g || *g != -key) {
+          ++misses;
+        }
+        if (i % 2) {
+          m.erase(key);
+        }
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  assert(misses == 0);
+  assert(m.size() == threads * per_thread / 2);
+  for (int key = 0; key < threads * per_thread; ++key) {
+    assert(m.contains(key) == (key % per_thread % 2 == 0));
+  }
+}
+
+int main() {
+  test_basic();
+  test_guarded();
+  test_guard_exhaustion();
+  test_grow();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
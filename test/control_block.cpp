@@ -0,0 +1,433 @@
+#include "atomic_shared_ptr.hpp"
+#include <cassert>
+#include <cstdint>
+#include <immintrin.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace lockfree;
+
+struct Counted {
+  static int alive;
+
+  std::string name;
+  long hits = 0;
+
+  explicit Counted(std::string n) : name(std::move(n)) { ++alive; }
+  ~Counted() { --alive; }
+};
+int Counted::alive = 0;
+
+struct Throws {
+  Throws() { throw std::runtime_error("no"); }
+};
+
+// Never referenced weakly.
+struct Lean {
+  static int alive;
+
+  long value;
+
+  explicit Lean(long v) : value(v) { ++alive; }
+  ~Lean() { --alive; }
+};
+int Lean::alive = 0;
+
+struct LeanBase {
+  virtual ~LeanBase() = default;
+};
+
+struct LeanDerived : LeanBase {};
+
+namespace lockfree {
+template <> struct disable_weak_ptr<Lean> : std::true_type {};
+template <> struct disable_weak_ptr<LeanDerived> : std::true_type {};
+} // namespace lockfree
+
+bool on_cache_line(const void *p) {
+  return reinterpret_cast<std::uintptr_t>(p) % detail::cache_line_size == 0;
+}
+
+template <typename Layout> void test_lifetime(Layout layout) {
+  {
+    auto p = make_shared<Counted>(layout, "x");
+    assert(Counted::alive == 1);
+    assert(p->name == "x");
+    auto q = p;
+    assert(p.use_count() == 2);
+    p.reset();
+    assert(Counted::alive == 1);
+    ++q->hits;
+  }
+  assert(Counted::alive == 0);
+
+  bool thrown = false;
+  try {
+    make_shared<Throws>(layout);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+void test_isolated_layout() {
+  auto p = make_shared<Counted>(isolated_layout, "y");
+  auto c = detail::shared_ptr_access<Counted>::ctrl(p);
+  assert(on_cache_line(p.get()));
+  assert(on_cache_line(c));
+  // The counters are in the line before the object.
+  assert(reinterpret_cast<char *>(p.get()) - reinterpret_cast<char *>(c) ==
+         detail::cache_line_size);
+  using block = detail::control_block_inplace<Counted, isolated_layout_t>;
+  static_assert(sizeof(block) % detail::cache_line_size == 0);
+}
+
+void test_packed_layout() {
+  // Plain make_shared is packed too.
+  for (auto p : {make_shared<long>(packed_layout, 7), make_shared<long>(7)}) {
+    auto c = detail::shared_ptr_access<long>::ctrl(p);
+    assert(*p == 7);
+    assert(std::size_t(reinterpret_cast<char *>(p.get()) -
+                       reinterpret_cast<char *>(c)) < detail::cache_line_size);
+  }
+}
+
+// Pointers from either layout go through atomic_shared_ptr like any other.
+void test_atomic() {
+  atomic_shared_ptr<Counted> a(make_shared<Counted>(isolated_layout, "a"));
+  a.store(make_shared<Counted>(packed_layout, "b"));
+  assert(a.load()->name == "b");
+  a.store(nullptr);
+  hazard_pointer_domain::global().scan();
+  assert(Counted::alive == 0);
+}
+
+void test_weak_ptr() {
+  weak_ptr<Counted> w;
+  assert(w.expired());
+  assert(!w.lock());
+  {
+    auto p = make_shared<Counted>("w");
+    w = p;
+    assert(w.use_count() == 1);
+    auto q = w.lock();
+    assert(q.get() == p.get());
+    assert(shared_ptr<Counted>(w).use_count() == 3);
+  }
+  // The object is gone but the block stays until the last weak_ptr.
+  assert(Counted::alive == 0);
+  assert(w.expired());
+  assert(!w.lock());
+  bool thrown = false;
+  try {
+    shared_ptr<Counted> p(w);
+  } catch (const std::bad_weak_ptr &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  auto p = make_shared<Counted>(isolated_layout, "v");
+  weak_ptr<const Counted> v = p;
+  p.reset();
+  assert(v.expired());
+}
+
+// Weak support costs nothing where it's disabled.
+void test_disable_weak_ptr() {
+  static_assert(
+      std::is_same_v<detail::control_block_base<Lean>, detail::control_block>);
+  static_assert(std::is_same_v<detail::control_block_base<Counted>,
+                               detail::weak_control_block>);
+#ifndef LOCKFREE_CHECK_BORROWS
+  // Checked borrows are counted in the block, which takes up the room saved.
+  static_assert(
+      sizeof(detail::control_block_inplace<Lean, packed_layout_t>) <
+      sizeof(detail::control_block_inplace<long, packed_layout_t>));
+#endif
+  {
+    auto p = make_shared<Lean>(1);
+    auto q = make_shared<Lean>(packed_layout, 2);
+    auto r = p;
+    assert(detail::shared_ptr_access<Lean>::ctrl(r)->weak() == nullptr);
+    assert(p->value + q->value == 3);
+    assert(Lean::alive == 2);
+  }
+  assert(Lean::alive == 0);
+
+  // Converting to a base that allows weak_ptr doesn't add a weak count.
+  shared_ptr<LeanBase> b = make_shared<LeanDerived>();
+  bool thrown = false;
+  try {
+    weak_ptr<LeanBase> w = b;
+  } catch (const std::bad_weak_ptr &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+using local_policy = shared_policy<plain_counter, true, inline_storage<>>;
+using lean_policy =
+    shared_policy<atomic_counter<std::memory_order_release>, false>;
+
+void test_policies() {
+  static_assert(std::is_same_v<shared_ptr<int>, basic_shared_ptr<int>>);
+  static_assert(
+      std::is_same_v<shared_ptr<int>, basic_shared_ptr<int, shared_policy<>>>);
+
+  {
+    auto p = make_basic_shared<Counted, local_policy>("local");
+    // Inline storage: the object lives in the control block.
+    using block = detail::control_block_inplace<Counted, packed_layout_t,
+                                                local_policy>;
+    static_assert(std::is_base_of_v<
+                  detail::basic_weak_control_block<plain_counter>, block>);
+    basic_weak_ptr<Counted, local_policy> w = p;
+    auto q = w.lock();
+    assert(p.use_count() == 2);
+    q.reset();
+    p.reset();
+    assert(Counted::alive == 0);
+    assert(w.expired());
+    assert(!w.lock());
+  }
+
+  {
+    // The policy turns weak support off for every type.
+    using base = detail::control_block_base<Counted, lean_policy>;
+    using counter = lean_policy::counter;
+    static_assert(
+        std::is_same_v<base, detail::basic_control_block<counter>>);
+    auto p = make_basic_shared<Counted, lean_policy>("lean");
+    basic_shared_ptr<const Counted, lean_policy> q = p;
+    p.reset();
+    assert(q->name == "lean");
+    assert(q.use_count() == 1);
+  }
+  assert(Counted::alive == 0);
+}
+
+struct Sentinel {
+  static bool destroyed;
+
+  int value = 5;
+
+  ~Sentinel() { destroyed = true; }
+};
+bool Sentinel::destroyed = false;
+
+void test_immortal() {
+  static const auto sentinel = make_immortal<Sentinel>();
+  auto c = detail::shared_ptr_access<Sentinel>::ctrl(sentinel.share());
+  assert(c->immortal());
+  {
+    auto p = sentinel.share();
+    auto q = p;
+    assert(q->value == 5);
+    assert(q.get() == sentinel.get());
+    assert(q.use_count() == p.use_count());
+    weak_ptr<Sentinel> w = q;
+    assert(w.lock().get() == sentinel.get());
+
+    atomic_shared_ptr<Sentinel> a(p);
+    a.store(nullptr);
+    hazard_pointer_domain::global().scan();
+  }
+  assert(!Sentinel::destroyed);
+  assert(sentinel->value == 5);
+
+  // Mortal blocks aren't affected.
+  auto p = make_shared<Sentinel>(packed_layout);
+  assert(!detail::shared_ptr_access<Sentinel>::ctrl(p)->immortal());
+  p.reset();
+  assert(Sentinel::destroyed);
+}
+
+// State objects of SIMD kernels.
+struct alignas(32) Vec8 {
+  float v[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+};
+
+struct alignas(64) Vec16 {
+  float v[16] = {1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8};
+};
+
+// vmovaps faults on an address that isn't 32-byte aligned.
+template <typename V> __attribute__((target("avx"))) float avx_sum(V *x) {
+  alignas(32) float out[8];
+  __m256 acc = _mm256_setzero_ps();
+  for (std::size_t i = 0; i < sizeof(V) / sizeof(float); i += 8) {
+    acc = _mm256_add_ps(acc, _mm256_load_ps(x->v + i));
+  }
+  _mm256_store_ps(out, acc);
+  float sum = 0;
+  for (float f : out) {
+    sum += f;
+  }
+  return sum;
+}
+
+template <typename V, typename P>
+void check_aligned(const basic_shared_ptr<V, P> &p) {
+  assert(reinterpret_cast<std::uintptr_t>(p.get()) % alignof(V) == 0);
+  if (__builtin_cpu_supports("avx")) {
+    assert(avx_sum(p.get()) == 36 * (sizeof(V) / 32));
+  }
+}
+
+// Counts the blocks it has out. Copies share the count.
+template <typename T> struct counting_allocator {
+  using value_type = T;
+
+  int *live;
+
+  explicit counting_allocator(int *l) : live(l) {}
+
+  template <typename U>
+  counting_allocator(const counting_allocator<U> &other) : live(other.live) {}
+
+  T *allocate(std::size_t n) {
+    ++*live;
+    return std::allocator<T>{}.allocate(n);
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    --*live;
+    std::allocator<T>{}.deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const counting_allocator<U> &other) const {
+    return live == other.live;
+  }
+};
+
+template <typename V> void test_over_aligned() {
+  check_aligned(make_shared<V>());
+  check_aligned(make_shared<V>(packed_layout));
+  check_aligned(make_shared<V>(isolated_layout));
+  check_aligned(make_basic_shared<V, local_policy>());
+  check_aligned(allocate_shared<V>(std::allocator<V>{}));
+  int live = 0;
+  check_aligned(allocate_shared<V>(counting_allocator<V>(&live)));
+  assert(live == 0);
+}
+
+void test_over_aligned_layout() {
+  // Counters and a 32-byte object share one line, and the block is aligned
+  // so that it can't straddle two.
+  using block8 = detail::control_block_inplace<Vec8, packed_layout_t>;
+  static_assert(sizeof(block8) == detail::cache_line_size);
+  static_assert(alignof(block8) == detail::cache_line_size);
+  // A whole-line object costs exactly one more line.
+  using block16 = detail::control_block_inplace<Vec16, packed_layout_t>;
+  static_assert(sizeof(block16) == 2 * detail::cache_line_size);
+  using allocated = detail::control_block_allocated<Vec8, std::allocator<Vec8>>;
+  static_assert(sizeof(allocated) == detail::cache_line_size);
+  static_assert(alignof(allocated) == detail::cache_line_size);
+  // Types operator new already aligns keep the plain layout.
+  static_assert(alignof(detail::control_block_inplace<long, packed_layout_t>) ==
+                alignof(detail::control_block));
+
+  auto p = make_shared<Vec8>(packed_layout);
+  auto c = detail::shared_ptr_access<Vec8>::ctrl(p);
+  assert(on_cache_line(c));
+  assert(reinterpret_cast<char *>(p.get()) - reinterpret_cast<char *>(c) ==
+         32);
+}
+
+void test_allocate_shared() {
+  int live = 0;
+  counting_allocator<Counted> alloc(&live);
+  weak_ptr<Counted> w;
+  {
+    auto p = allocate_shared<Counted>(alloc, "a");
+    assert(live == 1);
+    assert(p->name == "a");
+    w = p;
+  }
+  // The weak reference keeps the block, not the object.
+  assert(Counted::alive == 0);
+  assert(live == 1);
+  w.reset();
+  assert(live == 0);
+
+  bool thrown = false;
+  try {
+    allocate_shared<Throws>(counting_allocator<Throws>(&live));
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(live == 0);
+}
+
+// Counts its instances, and throws when the next id is `fail_at`.
+struct Element {
+  static int made;
+  static int fail_at;
+  static std::vector<int> destroyed;
+
+  int id;
+
+  Element() : id(made++) {
+    if (id == fail_at) {
+      throw std::runtime_error("no");
+    }
+  }
+  ~Element() { destroyed.push_back(id); }
+};
+int Element::made = 0;
+int Element::fail_at = -1;
+std::vector<int> Element::destroyed;
+
+void test_array() {
+  auto p = make_shared<long[]>(5);
+  for (int i = 0; i < 5; ++i) {
+    assert(p[i] == 0);
+  }
+  auto c = detail::shared_ptr_access<long[]>::ctrl(p);
+  assert(reinterpret_cast<char *>(p.get()) - reinterpret_cast<char *>(c) ==
+         sizeof(detail::control_block_array<long[]>));
+
+  auto v = make_shared<Vec16[]>(3);
+  for (int i = 0; i < 3; ++i) {
+    assert(reinterpret_cast<std::uintptr_t>(&v[i]) % 64 == 0);
+  }
+  assert(make_shared<int[]>(0).get() != nullptr);
+
+  // Destroyed last to first.
+  make_shared<Element[]>(3).reset();
+  assert((Element::destroyed == std::vector<int>{2, 1, 0}));
+
+  // A throwing element undoes the ones before it.
+  Element::made = 0;
+  Element::fail_at = 2;
+  Element::destroyed.clear();
+  bool thrown = false;
+  try {
+    make_shared<Element[]>(4);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(Element::destroyed.size() == 2);
+}
+
+int main() {
+  test_lifetime(packed_layout);
+  test_lifetime(isolated_layout);
+  test_isolated_layout();
+  test_packed_layout();
+  test_atomic();
+  test_weak_ptr();
+  test_disable_weak_ptr();
+  test_policies();
+  test_immortal();
+  test_over_aligned<Vec8>();
+  test_over_aligned<Vec16>();
+  test_over_aligned_layout();
+  test_allocate_shared();
+  test_array();
+  std::cout << "All tests passed!" << std::endl;
+}
@@ -0,0 +1,105 @@
+#include "cow_cell.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+using namespace lockfree;
+
+struct Config {
+  static std::atomic<int> alive;
+
+  std::string name;
+  long version = 0;
+
+  Config(std::string n) : name(std::move(n)) { ++alive; }
+  Config(const Config &other) : name(other.name), version(other.version) {
+    ++alive;
+  }
+  ~Config() { --alive; }
+};
+std::atomic<int> Config::alive = 0;
+
+// A cell is never copied, not even from a non-const lvalue, and only takes
+// arguments its value can be built from.
+static_assert(!std::is_constructible_v<cow_cell<Config>, cow_cell<Config> &>);
+static_assert(!std::is_constructible_v<cow_cell<int>, cow_cell<int> &>);
+static_assert(!std::is_constructible_v<cow_cell<Config>, int>);
+static_assert(std::is_constructible_v<cow_cell<Config>, const char *>);
+
+void test_snapshot() {
+  {
+    cow_cell<Config> cell("initial");
+    auto snap = cell.read();
+    assert(snap->name == "initial");
+
+    auto published = cell.update([](Config &c) {
+      c.name = "updated";
+      ++c.version;
+    });
+    assert(published->version == 1);
+
+    // The old snapshot is untouched and still alive.
+    assert(snap->name == "initial");
+    assert(cell.read()->name == "updated");
+    assert(Config::alive == 2);
+
+    snap.reset();
+    // Nobody holds version 0 any more.
+    assert(Config::alive == 1);
+
+    auto g = cell.read_guarded();
+    assert(g->version == 1);
+  }
+  assert(Config::alive == 0);
+}
+
+void test_store() {
+  cow_cell<int> cell(1);
+  cell.store(2);
+  assert(*cell.read() == 2);
+}
+
+void test_concurrent_updates() {
+  constexpr int threads = 4;
+  constexpr int per_thread = 2000;
+  cow_cell<long> cell(0);
+  std::atomic<bool> done = false;
+
+  // Readers only ever see versions that writers published, in order.
+  std::thread reader([&] {
+    long last = 0;
+    while (!done) {
+      long v = *cell.read();
+      assert(v >= last);
+      last = v;
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; ++t) {
+    writers.emplace_back([&] {
+      for (int i = 0; i < per_thread; ++i) {
+        cell.update([](long &v) { ++v; });
+      }
+    });
+  }
+  for (auto &w : writers) {
+    w.join();
+  }
+  done = true;
+  reader.join();
+
+  assert(*cell.read() == threads * per_thread);
+}
+
+int main() {
+  test_snapshot();
+  test_store();
+  test_concurrent_updates();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "ibr_domain.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+struct Counted : ibr_domain::object {
+  static std::atomic<int> alive;
+
+  int value;
+
+  Counted(int v) : value(v) { ++alive; }
+  ~Counted() {
+    value = -1;
+    --alive;
+  }
+};
+std::atomic<int> Counted::alive = 0;
+
+void test_guard_delays_reclamation() {
+  ibr_domain domain;
+  auto writer = domain.register_thread();
+  auto reader = domain.register_thread();
+  std::atomic<Counted *> shared{new Counted(0)};
+  {
+    auto g = reader.pin();
+    Counted *c = reader.protect(shared);
+    writer.retire(shared.exchange(new Counted(1)));
+    writer.collect();
+    assert(c->value == 0);
+  }
+  writer.collect();
+  assert(Counted::alive == 1);
+  delete shared.load();
+}
+
+void test_custom_deleter() {
+  ibr_domain domain;
+  auto h = domain.register_thread();
+  int deleted = 0;
+  h.retire(new Counted(0), [&](Counted *p) {
+    ++deleted;
+    delete p;
+  });
+  h.collect();
+  assert(deleted == 1);
+  assert(Counted::alive == 0);
+}
+
+void test_shared_ptr() {
+  ibr_domain domain;
+  auto writer = domain.register_thread();
+  auto reader = domain.register_thread();
+  auto p = make_shared<Counted>(7);
+  Counted *raw = p.get();
+  {
+    auto g = reader.pin();
+    writer.retire(std::move(p));
+    writer.collect();
+    assert(raw->value == 7);
+  }
+  writer.collect();
+  assert(Counted::alive == 0);
+}
+
+// A reader stops inside its guard. Objects born after it stalled don't
+// overlap its reservation, so the writer keeps freeing them.
+void test_stalled_reader() {
+  constexpr int updates = 100000;
+  ibr_domain domain;
+  std::atomic<Counted *> shared{new Counted(0)};
+  std::atomic<bool> reading = false;
+  std::atomic<bool> resume = false;
+
+  std::thread reader([&] {
+    auto h = domain.register_thread();
+    auto g = h.pin();
+    Counted *c = h.protect(shared);
+    reading = true;
+    while (!resume) {
+      std::this_thread::yield();
+    }
+    assert(c->value == 0);
+  });
+  while (!reading) {
+    std::this_thread::yield();
+  }
+
+  auto h = domain.register_thread();
+  long peak = 0;
+  for (int i = 1; i <= updates; ++i) {
+    h.retire(shared.exchange(new Counted(i)));
+    peak = std::max<long>(peak, Counted::alive);
+  }
+  // Pinned: the object the reader holds and whatever was alive in the era
+  // it read in. Everything else is freed every batch.
+  assert(peak < 4 * long(ibr_domain::batch_size));
+  assert(domain.limbo_size() < 4 * long(ibr_domain::batch_size));
+
+  resume = true;
+  reader.join();
+  h.collect();
+  assert(Counted::alive == 1);
+  delete shared.load();
+}
+
+void test_concurrent() {
+  constexpr int readers = 3;
+  constexpr int updates = 20000;
+  ibr_domain domain;
+  std::atomic<Counted *> shared{new Counted(0)};
+  std::atomic<bool> done = false;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < readers; ++t) {
+    threads.emplace_back([&] {
+      auto h = domain.register_thread();
+      while (!done) {
+        auto g = h.pin();
+        assert(h.protect(shared)->value >= 0);
+      }
+    });
+  }
+  threads.emplace_back([&] {
+    auto h = domain.register_thread();
+    for (int i = 1; i <= updates; ++i) {
+      h.retire(shared.exchange(new Counted(i)));
+    }
+    done = true;
+  });
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  auto h = domain.register_thread();
+  h.collect();
+  assert(Counted::alive == 1);
+  delete shared.load();
+}
+
+int main() {
+  test_guard_delays_reclamation();
+  test_custom_deleter();
+  test_shared_ptr();
+  test_stalled_reader();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,207 @@
+#include "object_pool.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+struct Request {
+  static std::atomic<int> alive;
+  static std::atomic<int> constructed;
+
+  std::string path;
+  std::vector<int> body;
+
+  explicit Request(std::string p = "") : path(std::move(p)) {
+    ++alive;
+    ++constructed;
+  }
+  ~Request() { --alive; }
+};
+std::atomic<int> Request::alive = 0;
+std::atomic<int> Request::constructed = 0;
+
+void reset_request(Request &r) {
+  r.path.clear();
+  r.body.clear(); // Keeps the capacity.
+}
+
+struct Throws {
+  explicit Throws(bool fail) {
+    if (fail) {
+      throw std::runtime_error("no");
+    }
+  }
+};
+
+struct alignas(64) Aligned {
+  int value = 0;
+};
+
+void test_recycles() {
+  object_pool<Request> pool;
+  const void *first;
+  {
+    auto p = make_pooled(pool, "/a");
+    assert(p->path == "/a");
+    assert(p.use_count() == 1);
+    assert(Request::alive == 1);
+    first = p.get();
+  }
+  assert(Request::alive == 0);
+  auto q = make_pooled(pool, "/b");
+  assert(q.get() == first);
+  assert(q->path == "/b");
+  assert(pool.allocated() == 1);
+  auto r = make_pooled(pool);
+  assert(r.get() != first);
+  assert(pool.allocated() == 2);
+}
+
+void test_reset() {
+  Request::constructed = 0;
+  {
+    object_pool<Request> pool(reset_request);
+    const int *data;
+    {
+      auto p = make_pooled(pool, "/a");
+      p->body.resize(100);
+      data = p->body.data();
+    }
+    // Reset, not destroyed.
+    assert(Request::alive == 1);
+    auto p = make_pooled(pool, "/ignored");
+    assert(Request::constructed == 1);
+    assert(p->path.empty());
+    assert(p->body.empty());
+    assert(p->body.capacity() >= 100);
+    p->body.resize(100);
+    assert(p->body.data() == data);
+  }
+  // The pool destroys what it kept.
+  assert(Request::alive == 0);
+}
+
+void test_weak_ptr() {
+  object_pool<Request> pool;
+  weak_ptr<Request> w;
+  const void *first;
+  {
+    auto p = make_pooled(pool, "/a");
+    first = p.get();
+    w = p;
+    assert(w.lock().get() == p.get());
+  }
+  assert(Request::alive == 0);
+  assert(w.expired());
+  // The weak reference still holds the block, so the slot isn't free.
+  auto q = make_pooled(pool, "/b");
+  assert(q.get() != first);
+  w.reset();
+  auto r = make_pooled(pool, "/c");
+  assert(r.get() == first);
+}
+
+void test_throwing_constructor() {
+  object_pool<Throws> pool;
+  bool thrown = false;
+  try {
+    make_pooled(pool, true);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  // The slot went back to the pool.
+  auto p = make_pooled(pool, false);
+  assert(pool.allocated() == 1);
+}
+
+void test_over_aligned() {
+  object_pool<Aligned> pool;
+  std::vector<shared_ptr<Aligned>> v;
+  for (int i = 0; i < 10; ++i) {
+    v.push_back(make_pooled(pool));
+    assert(reinterpret_cast<std::uintptr_t>(v.back().get()) % 64 == 0);
+  }
+}
+
+void test_thread_exit() {
+  object_pool<Request> pool;
+  std::thread([&] {
+    std::vector<shared_ptr<Request>> v;
+    for (int i = 0; i < 10; ++i) {
+      v.push_back(make_pooled(pool));
+    }
+  }).join();
+  assert(pool.allocated() == 10);
+  // The exited thread's cache went back to the shared list.
+  std::vector<shared_ptr<Request>> v;
+  for (int i = 0; i < 10; ++i) {
+    v.push_back(make_pooled(pool));
+  }
+  assert(pool.allocated() == 10);
+}
+
+// Short-lived pools, each used once by a thread that outlives them all.
+void test_many_pools() {
+  object_pool<Request> outer;
+  auto kept = make_pooled(outer, "kept");
+  for (int i = 0; i < 1000; ++i) {
+    object_pool<Request> pool;
+    auto p = make_pooled(pool, "short");
+    assert(p->path == "short");
+  }
+  kept.reset();
+  auto again = make_pooled(outer);
+  assert(outer.allocated() == 1);
+}
+
+// Objects made on one thread and released on another, through a mailbox,
+// so slots keep moving between caches and the shared list.
+void test_concurrent() {
+  constexpr int threads = 4;
+  constexpr int iterations = 20000;
+  object_pool<Request> pool;
+  std::mutex mutex;
+  shared_ptr<Request> mailbox;
+  std::vector<std::thread> ts;
+  for (int t = 0; t < threads; ++t) {
+    ts.emplace_back([&, t] {
+      std::string name = std::to_string(t);
+      for (int i = 0; i < iterations; ++i) {
+        auto p = make_pooled(pool, name);
+        {
+          std::lock_guard lk(mutex);
+          std::swap(p, mailbox);
+        }
+        if (auto old = std::move(p)) {
+          assert(old->path.size() == 1);
+        }
+      }
+    });
+  }
+  for (auto &t : ts) {
+    t.join();
+  }
+  mailbox.reset();
+  assert(Request::alive == 0);
+  // Slots were reused rather than allocated for each object.
+  assert(pool.allocated() < threads * iterations / 100);
+}
+
+int main() {
+  test_recycles();
+  test_reset();
+  test_weak_ptr();
+  test_throwing_constructor();
+  test_over_aligned();
+  test_thread_exit();
+  test_many_pools();
+  test_concurrent();
+  std::cout << "All tests passed!" << std::endl;
+}
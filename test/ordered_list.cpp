@@ -0,0 +1,131 @@
+#include "ordered_list.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+struct Counted {
+  static std::atomic<int> alive;
+
+  int value;
+
+  Counted(int v) : value(v) { ++alive; }
+  Counted(const Counted &other) : value(other.value) { ++alive; }
+  ~Counted() { --alive; }
+};
+std::atomic<int> Counted::alive = 0;
+
+void test_basic() {
+  ordered_list<int, int> l;
+  assert(l.empty());
+  assert(!l.find(1));
+  assert(l.insert(3, make_shared<int>(30)));
+  assert(l.insert(1, make_shared<int>(10)));
+  assert(l.insert(2, make_shared<int>(20)));
+  assert(!l.insert(2, make_shared<int>(0)));
+  assert(*l.find(2) == 20);
+  assert(!l.insert_or_assign(2, make_shared<int>(21)));
+  assert(*l.find(2) == 21);
+  assert(l.size() == 3);
+
+  assert(l.erase(2));
+  assert(!l.erase(2));
+  assert(!l.contains(2));
+  assert(l.contains(1) && l.contains(3));
+  assert(l.size() == 2);
+}
+
+void test_order() {
+  ordered_list<int, int, std::greater<int>> l;
+  for (int i : {5, 1, 4, 2, 3}) {
+    l.insert(i, make_shared<int>(i * 10));
+  }
+
+  std::vector<int> keys;
+  for (auto it = l.begin(); it != l.end(); ++it) {
+    assert(*it.value() == it.key() * 10);
+    keys.push_back(it.key());
+  }
+  assert((keys == std::vector<int>{5, 4, 3, 2, 1}));
+
+  keys.clear();
+  l.for_each([&](int key, const int &value) {
+    assert(value == key * 10);
+    keys.push_back(key);
+  });
+  assert((keys == std::vector<int>{5, 4, 3, 2, 1}));
+}
+
+void test_no_leak() {
+  {
+    ordered_list<int, Counted> l;
+    for (int i = 0; i < 1000; ++i) {
+      l.insert(i, make_shared<Counted>(i));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+      l.erase(i);
+    }
+    l.insert_or_assign(1, make_shared<Counted>(-1));
+  }
+  hazard_pointer_domain::global().scan();
+  assert(Counted::alive == 0);
+}
+
+void test_concurrent() {
+  constexpr int threads = 4;
+  constexpr int keys = 400;
+  ordered_list<int, int> l;
+  std::atomic<bool> done = false;
+
+  // Same scheme as the skiplist test: every key is inserted by one thread and
+  // the odd ones are erased by another, while a reader checks the order.
+  std::thread reader([&] {
+    while (!done) {
+      int last = -1;
+      l.for_each([&](int key, int value) {
+        assert(key > last && value == key);
+        last = key;
+      });
+    }
+  });
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int k = t; k < keys; k += threads) {
+        assert(l.insert(k, make_shared<int>(k)));
+      }
+      for (int k = (t + 1) % threads; k < keys; k += threads) {
+        if (k % 2) {
+          while (!l.erase(k)) {
+            // Not inserted by its owner yet.
+          }
+        }
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  done = true;
+  reader.join();
+
+  assert(l.size() == keys / 2);
+  int count = 0;
+  for (auto it = l.begin(); it != l.end(); ++it) {
+    assert(it.key() % 2 == 0);
+    ++count;
+  }
+  assert(count == keys / 2);
+}
+
+int main() {
+  test_basic();
+  test_order();
+  test_no_leak();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
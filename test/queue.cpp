@@ -0,0 +1,118 @@
+#include "queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+// Counts copies so we can check that values are only ever moved.
+struct MoveOnly {
+  static std::atomic<int> alive;
+
+  std::unique_ptr<int> value;
+
+  MoveOnly(int v) : value(new int(v)) { ++alive; }
+  MoveOnly(MoveOnly &&other) : value(std::move(other.value)) { ++alive; }
+  ~MoveOnly() { --alive; }
+};
+std::atomic<int> MoveOnly::alive = 0;
+
+void test_fifo() {
+  queue<int> q;
+  assert(q.empty());
+  assert(!q.try_pop());
+
+  for (int i = 0; i < 10; ++i) {
+    q.push(i);
+  }
+  assert(!q.empty());
+  for (int i = 0; i < 10; ++i) {
+    auto v = q.try_pop();
+    assert(v && *v == i);
+  }
+  assert(q.empty());
+}
+
+void test_move_only() {
+  {
+    queue<MoveOnly> q;
+    q.emplace(1);
+    q.push(MoveOnly{2});
+    auto v = q.try_pop();
+    assert(*v->value == 1);
+  }
+  hazard_pointer_domain::global().scan();
+  assert(MoveOnly::alive == 0);
+}
+
+void test_shared_ptr_payload() {
+  queue<shared_ptr<int>> q;
+  auto p = make_shared<int>(7);
+  q.push(p);
+  assert(p.use_count() == 2);
+  auto v = q.try_pop();
+  // The reference was moved out of the queue, not copied.
+  assert(p.use_count() == 2);
+  v.reset();
+  assert(p.use_count() == 1);
+}
+
+void test_long_chain() {
+  queue<int> q;
+  for (int i = 0; i < 200000; ++i) {
+    q.push(i);
+  }
+}
+
+void test_concurrent() {
+  constexpr int producers = 3;
+  constexpr int consumers = 3;
+  constexpr int per_producer = 20000;
+  queue<int> q;
+  std::atomic<long> sum = 0;
+  std::atomic<int> consumed = 0;
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < per_producer; ++i) {
+        q.push(p * per_producer + i);
+      }
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&] {
+      // Per producer, values must come out in the order they went in.
+      std::vector<int> last(producers, -1);
+      while (consumed.load() < producers * per_producer) {
+        if (auto v = q.try_pop()) {
+          int p = *v / per_producer;
+          assert(*v > last[p]);
+          last[p] = *v;
+          sum += *v;
+          ++consumed;
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  constexpr long n = long(producers) * per_producer;
+  assert(q.empty());
+  assert(sum == n * (n - 1) / 2);
+}
+
+int main() {
+  test_fifo();
+  test_move_only();
+  test_shared_ptr_payload();
+  test_long_chain();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
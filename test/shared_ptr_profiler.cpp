@@ -0,0 +1,179 @@
+#include "arena.hpp"
+#include "shared_ptr.hpp"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+// Built with LOCKFREE_PROFILE_SHARED, see CMakeLists.txt.
+
+struct Blob {
+  char bytes[100];
+};
+
+struct Small {
+  int x = 0;
+};
+
+using sites = std::vector<shared_ptr_profiler::site>;
+
+long objects_of(const sites &s, const std::string &type) {
+  long n = 0;
+  for (auto &x : s) {
+    if (x.type == type) {
+      n += x.estimated_objects;
+    }
+  }
+  return n;
+}
+
+// Two distinct creation sites.
+[[gnu::noinline]] shared_ptr<Blob> make_cache_entry() {
+  auto p = make_shared<Blob>(packed_layout);
+  asm volatile("" ::: "memory");
+  return p;
+}
+
+[[gnu::noinline]] shared_ptr<Blob> make_request_buffer() {
+  auto p = shared_ptr<Blob>(new Blob);
+  asm volatile("" ::: "memory");
+  return p;
+}
+
+void test_disabled() {
+  shared_ptr_profiler::set_sample_rate(0);
+  auto p = make_shared<Blob>(packed_layout);
+  assert(shared_ptr_profiler::live_sites().empty());
+}
+
+void test_sites() {
+  shared_ptr_profiler::set_sample_rate(1); // Every creation.
+  std::vector<shared_ptr<Blob>> cache, requests;
+  for (int i = 0; i < 3; ++i) {
+    cache.push_back(make_cache_entry());
+  }
+  for (int i = 0; i < 2; ++i) {
+    requests.push_back(make_request_buffer());
+  }
+  auto small = make_shared<Small>(packed_layout);
+
+  auto s = shared_ptr_profiler::live_sites();
+  assert(s.size() == 3);
+  // Most bytes first.
+  assert(s[0].type == "Blob" && s[0].estimated_objects == 3);
+  assert(s[0].estimated_bytes == 300 && s[0].size == sizeof(Blob));
+  assert(s[1].type == "Blob" && s[1].estimated_objects == 2);
+  assert(s[2].type == "Small" && s[2].samples == 1);
+  assert(!s[0].frames.empty() && s[0].frames != s[1].frames);
+
+  // Objects leave the report when destroyed, even if weak_ptrs keep their
+  // blocks.
+  weak_ptr<Blob> w = cache.back();
+  cache.pop_back();
+  requests.clear();
+  s = shared_ptr_profiler::live_sites();
+  assert(objects_of(s, "Blob") == 2);
+
+  std::FILE *f = std::tmpfile();
+  shared_ptr_profiler::report(f);
+  std::rewind(f);
+  char buf[4096] = {};
+  std::fread(buf, 1, sizeof(buf) - 1, f);
+  std::fclose(f);
+  assert(std::strstr(buf, "live shared objects by site"));
+  assert(std::strstr(buf, "Blob (100 bytes each)"));
+
+  cache.clear();
+  small.reset();
+  assert(shared_ptr_profiler::live_sites().empty());
+}
+
+// 1 in 100: the estimate lands near the real count.
+void test_estimate() {
+  shared_ptr_profiler::set_sample_rate(100);
+  std::vector<shared_ptr<Small>> v;
+  for (int i = 0; i < 100000; ++i) {
+    v.push_back(make_shared<Small>(packed_layout));
+  }
+  long estimate = objects_of(shared_ptr_profiler::live_sites(), "Small");
+  assert(estimate > 80000 && estimate < 120000);
+  v.clear();
+  assert(objects_of(shared_ptr_profiler::live_sites(), "Small") == 0);
+  shared_ptr_profiler::set_sample_rate(0);
+}
+
+void test_periodic_report() {
+  shared_ptr_profiler::set_sample_rate(1);
+  auto p = make_shared<Blob>(packed_layout);
+  std::FILE *f = std::tmpfile();
+  {
+    shared_ptr_profiler::periodic_report r(std::chrono::milliseconds(5), f);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  std::rewind(f);
+  int reports = 0;
+  char line[512];
+  while (std::fgets(line, sizeof(line), f)) {
+    reports += std::strstr(line, "live shared objects by site") != nullptr;
+  }
+  std::fclose(f);
+  assert(reports >= 2);
+  shared_ptr_profiler::set_sample_rate(0);
+}
+
+// make_shared<T[]> knows the length; shared_ptr<T[]>(new T[n]) doesn't.
+void test_arrays() {
+  shared_ptr_profiler::set_sample_rate(1);
+  auto made = make_shared<Blob[]>(4);
+  shared_ptr<Small[]> adopted(new Small[4]);
+  auto s = shared_ptr_profiler::live_sites();
+  assert(s.size() == 2);
+  assert(s[0].size == 4 * sizeof(Blob) && !s[0].approximate);
+  assert(s[1].size == sizeof(Small) && s[1].approximate);
+
+  std::FILE *f = std::tmpfile();
+  shared_ptr_profiler::report(f);
+  std::rewind(f);
+  char buf[4096] = {};
+  std::fread(buf, 1, sizeof(buf) - 1, f);
+  std::fclose(f);
+  assert(std::strstr(buf, "Blob [] (400 bytes each)"));
+  assert(std::strstr(buf, "Small [] (4 bytes per element, length unknown)"));
+
+  made.reset();
+  adopted.reset();
+  assert(shared_ptr_profiler::live_sites().empty());
+  shared_ptr_profiler::set_sample_rate(0);
+}
+
+// Arena objects die at reset(), not through their counts.
+void test_arena() {
+  shared_ptr_profiler::set_sample_rate(1);
+  {
+    arena a;
+    for (int i = 0; i < 10; ++i) {
+      make_shared_in<std::string>(a, "arena");
+      make_shared_in<Small>(a);
+    }
+    assert(objects_of(shared_ptr_profiler::live_sites(), "Small") == 10);
+    a.reset();
+    assert(shared_ptr_profiler::live_sites().empty());
+    make_shared_in<Small>(a);
+  }
+  assert(shared_ptr_profiler::live_sites().empty());
+  shared_ptr_profiler::set_sample_rate(0);
+}
+
+int main() {
+  test_disabled();
+  test_sites();
+  test_arena();
+  test_arrays();
+  test_estimate();
+  test_periodic_report();
+  std::cout << "All tests passed!" << std::endl;
+}
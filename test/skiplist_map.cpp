@@ -0,0 +1,131 @@
+#include "skiplist_map.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+void test_basic() {
+  skiplist_map<int, int> m;
+  assert(!m.find(1));
+  assert(m.insert(3, make_shared<int>(30)));
+  assert(m.insert(1, make_shared<int>(10)));
+  assert(m.insert(2, make_shared<int>(20)));
+  assert(!m.insert(2, make_shared<int>(0)));
+  assert(*m.find(2) == 20);
+  assert(!m.insert_or_assign(2, make_shared<int>(21)));
+  assert(*m.find(2) == 21);
+  assert(m.size() == 3);
+
+  assert(m.erase(2));
+  assert(!m.erase(2));
+  assert(!m.contains(2));
+  assert(m.contains(1) && m.contains(3));
+  assert(m.size() == 2);
+}
+
+void test_iteration() {
+  skiplist_map<int, int> m;
+  for (int i = 0; i < 100; i += 2) {
+    m.insert(i, make_shared<int>(i * 10));
+  }
+
+  int expected = 0;
+  for (auto it = m.begin(); it != m.end(); ++it) {
+    assert(it.key() == expected);
+    assert(*it.value() == expected * 10);
+    expected += 2;
+  }
+  assert(expected == 100);
+
+  auto it = m.lower_bound(31);
+  assert(it.key() == 32);
+
+  std::vector<int> keys;
+  for (auto [key, value] : m.scan(10, 20)) {
+    assert(*value == key * 10);
+    keys.push_back(key);
+  }
+  assert((keys == std::vector<int>{10, 12, 14, 16, 18}));
+}
+
+void test_iterator_survives_erase() {
+  skiplist_map<int, int> m;
+  for (int i = 0; i < 10; ++i) {
+    m.insert(i, make_shared<int>(i));
+  }
+  auto it = m.lower_bound(3);
+  for (int i = 3; i < 6; ++i) {
+    m.erase(i);
+  }
+  // The erased node is still alive and leads back into the list.
+  assert(it.key() == 3);
+  ++it;
+  assert(it.key() == 6);
+}
+
+void test_long_chain() {
+  skiplist_map<int, int> m;
+  for (int i = 0; i < 100000; ++i) {
+    m.insert(i, nullptr);
+  }
+}
+
+void test_concurrent() {
+  constexpr int threads = 4;
+  constexpr int keys = 2000;
+  skiplist_map<int, int> m;
+  std::atomic<bool> done = false;
+
+  // Every key is inserted by one thread, then the odd ones are erased by
+  // another. A concurrent scan must always be sorted.
+  std::thread scanner([&] {
+    while (!done) {
+      int last = -1;
+      for (auto it = m.begin(); it != m.end(); ++it) {
+        assert(it.key() > last);
+        last = it.key();
+      }
+    }
+  });
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int k = t; k < keys; k += threads) {
+        assert(m.insert(k, make_shared<int>(k)));
+      }
+      for (int k = (t + 1) % threads; k < keys; k += threads) {
+        if (k % 2) {
+          while (!m.erase(k)) {
+            // Not inserted by its owner yet.
+          }
+        }
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  done = true;
+  scanner.join();
+
+  assert(m.size() == keys / 2);
+  int count = 0;
+  for (auto it = m.begin(); it != m.end(); ++it) {
+    assert(it.key() % 2 == 0);
+    ++count;
+  }
+  assert(count == keys / 2);
+}
+
+int main() {
+  test_basic();
+  test_iteration();
+  test_iterator_survives_erase();
+  test_long_chain();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "shared_ptr.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+static_assert(slab_allocator::class_size(0) == 16);
+static_assert(slab_allocator::class_size(7) == 128);
+static_assert(slab_allocator::class_size(8) == 192);
+static_assert(slab_allocator::class_size(slab_allocator::classes - 1) ==
+              slab_allocator::max_size);
+static_assert(slab_allocator::class_of(1, 16) == 0);
+static_assert(slab_allocator::class_of(24, 16) == 1);
+static_assert(slab_allocator::class_of(129, 16) == 8);
+static_assert(slab_allocator::class_of(40, 32) == 3);
+static_assert(slab_allocator::class_of(72, 64) == 7);
+static_assert(slab_allocator::class_of(513, 16) == -1);
+static_assert(slab_allocator::class_of(64, 128) == -1);
+
+bool aligned(const void *p, std::size_t align) {
+  return reinterpret_cast<std::uintptr_t>(p) % align == 0;
+}
+
+void test_classes() {
+  for (int c = 0; c < slab_allocator::classes; ++c) {
+    std::size_t size = slab_allocator::class_size(c);
+    assert(slab_allocator::class_of(size, 16) == c);
+    std::vector<void *> v;
+    for (int i = 0; i < 100; ++i) {
+      void *p = slab_allocator::allocate(size);
+      assert(aligned(p, 16));
+      v.push_back(p);
+    }
+    for (void *p : v) {
+      slab_allocator::deallocate(p, size);
+    }
+  }
+}
+
+void test_reuse() {
+  void *p = slab_allocator::allocate(48);
+  slab_allocator::deallocate(p, 48);
+  void *q = slab_allocator::allocate(40);
+  assert(q == p);
+  slab_allocator::deallocate(q, 40);
+}
+
+void test_alignment() {
+  for (std::size_t align : {32, 64}) {
+    std::vector<void *> v;
+    for (int i = 0; i < 100; ++i) {
+      v.push_back(slab_allocator::allocate(align + 8, align));
+      assert(aligned(v.back(), align));
+    }
+    for (void *p : v) {
+      slab_allocator::deallocate(p, align + 8, align);
+    }
+  }
+}
+
+void test_fallback() {
+  void *p = slab_allocator::allocate(4096);
+  void *q = slab_allocator::allocate(64, 256);
+  assert(aligned(q, 256));
+  slab_allocator::deallocate(p, 4096);
+  slab_allocator::deallocate(q, 64, 256);
+}
+
+// Blocks made on one thread and dropped on others, whose caches go back to
+// the depot when they exit.
+void test_cross_thread() {
+  constexpr int threads = 4;
+  constexpr int objects = 10000;
+  std::vector<std::vector<shared_ptr<int>>> made(threads);
+  for (int t = 0; t < threads; ++t) {
+    for (int i = 0; i < objects; ++i) {
+      made[t].push_back(lockfree::make_shared<int>(packed_layout, i));
+    }
+  }
+  std::vector<std::thread> ts;
+  for (int t = 0; t < threads; ++t) {
+    ts.emplace_back([&, t] {
+      for (int i = 0; i < objects; ++i) {
+        assert(*made[t][i] == i);
+      }
+      made[t].clear();
+    });
+  }
+  for (auto &t : ts) {
+    t.join();
+  }
+#ifdef LOCKFREE_HAVE_SLAB
+  // Dropped blocks are reused rather than carved again.
+  std::size_t reserved = slab_allocator::reserved_bytes();
+  std::vector<shared_ptr<int>> again;
+  for (int i = 0; i < threads * objects; ++i) {
+    again.push_back(lockfree::make_shared<int>(packed_layout, i));
+  }
+  assert(slab_allocator::reserved_bytes() == reserved);
+#endif
+}
+
+int main() {
+  test_classes();
+  test_reuse();
+  test_alignment();
+  test_fallback();
+  test_cross_thread();
+  std::cout << "All tests passed!" << std::endl;
+}
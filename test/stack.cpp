@@ -0,0 +1,107 @@
+#include "stack.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace lockfree;
+
+struct Counted {
+  static std::atomic<int> alive;
+
+  int value;
+
+  Counted(int v) : value(v) { ++alive; }
+  Counted(const Counted &other) : value(other.value) { ++alive; }
+  ~Counted() { --alive; }
+};
+std::atomic<int> Counted::alive = 0;
+
+void test_lifo() {
+  stack<int> s;
+  assert(s.empty());
+  assert(!s.try_pop());
+
+  for (int i = 0; i < 10; ++i) {
+    s.push(i);
+  }
+  for (int i = 9; i >= 0; --i) {
+    auto p = s.try_pop();
+    assert(p && *p == i);
+  }
+  assert(s.empty());
+}
+
+void test_push_range_pop_all() {
+  stack<int> s;
+  std::vector<int> v{1, 2, 3, 4};
+  s.push(0);
+  s.push_range(v.begin(), v.end());
+
+  auto top = s.try_pop();
+  assert(*top == 4);
+
+  auto all = s.pop_all();
+  assert(all.size() == 4);
+  for (int i = 0; i < 4; ++i) {
+    assert(*all[i] == 3 - i);
+  }
+  assert(s.empty());
+  assert(s.pop_all().empty());
+}
+
+void test_no_leak() {
+  {
+    stack<Counted> s;
+    for (int i = 0; i < 100000; ++i) {
+      s.push(Counted{i});
+    }
+    auto p = s.try_pop();
+    assert(p->value == 99999);
+  }
+  // Retired references are dropped once the hazard pointer domain scans.
+  hazard_pointer_domain::global().scan();
+  assert(Counted::alive == 0);
+}
+
+void test_concurrent() {
+  constexpr int threads = 4;
+  constexpr int per_thread = 20000;
+  stack<int> s;
+  std::atomic<long> popped_sum = 0;
+  std::atomic<int> popped = 0;
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < per_thread; ++i) {
+        s.push(t * per_thread + i);
+        if (auto p = s.try_pop()) {
+          popped_sum += *p;
+          ++popped;
+        }
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  for (auto &p : s.pop_all()) {
+    popped_sum += *p;
+    ++popped;
+  }
+
+  constexpr long n = long(threads) * per_thread;
+  assert(popped == n);
+  assert(popped_sum == n * (n - 1) / 2);
+}
+
+int main() {
+  test_lifo();
+  test_push_range_pop_all();
+  test_no_leak();
+  test_concurrent();
+
+  std::cout << "All tests passed!" << std::endl;
+  return 0;
+}